@@ -17,8 +17,8 @@
 #pragma once
 
 #ifdef AUDIO_ENABLE
-#    define STARTUP_SONG SONG(PLANCK_SOUND)
-// #define STARTUP_SONG SONG(NO_SOUND)
+// the planck song is played by the keymap once the board is up, see startup_task
+#    define STARTUP_SONG SONG(NO_SOUND)
 
 #    define DEFAULT_LAYER_SONGS \
         { SONG(QWERTY_SOUND), SONG(COLEMAK_SOUND), SONG(DVORAK_SOUND) }
@@ -57,6 +57,36 @@
 #define MOUSEKEY_DELAY 150
 #define MOUSEKEY_MAX_SPEED 9
 
+// wheel keys go through the keymap's scroll engine: speed is 8.8 fixed point
+// wheel clicks per tick, ramps up once held for SCROLL_DELAY ms and eases out
+// after release
+#define SCROLL_DELAY MOUSEKEY_DELAY
+#define SCROLL_INTERVAL 16
+#define SCROLL_ACCEL 40
+#define SCROLL_MAX_SPEED (4 << 8)
+#define SCROLL_MOMENTUM_MIN (1 << 8)
+#define SCROLL_FRICTION 3
+#define SCROLL_MAX_STEPS 4
+
+// held h/j/k/l/w/e/b in the vim layer: first repeat after VIM_REPEAT_DELAY ms, then
+// every VIM_REPEAT_INTERVAL ms getting VIM_REPEAT_ACCEL ms faster each time, down to VIM_REPEAT_MIN
+#define VIM_REPEAT_DELAY 180
+#define VIM_REPEAT_INTERVAL 50
+#define VIM_REPEAT_ACCEL 4
+#define VIM_REPEAT_MIN 12
+
+// taps the vim layer can't send all at once (held motions) queue up to TAP_QUEUE_SIZE
+// different taps and go out TAP_QUEUE_PER_SCAN per matrix scan. a vim command whose
+// taps don't all fit behind what's queued is dropped whole
+#define TAP_QUEUE_SIZE 8
+#define TAP_QUEUE_PER_SCAN 4
+
+// ms after boot before the startup song and RGB come on
+#define STARTUP_DEFER 500
+
+// ms between keys when typing out a snippet
+#define SNIPPET_INTERVAL 3
+
 #define GUITAB LGUI(KC_TAB)
 //#define ALT_AA RALT_T(SWE_AA)
 
@@ -69,6 +99,9 @@
 #define L_GUI_HELD (get_mods() & (MOD_BIT(KC_LGUI)))
 #define R_GUI_HELD (get_mods() & (MOD_BIT(KC_RGUI)))
 #define GUI_HELD (L_GUI_HELD || R_GUI_HELD)
+// cycle counts per keypress path, dumped to the console from the admin layer (F10).
+// needs CONSOLE_ENABLE = yes in rules.mk, rev6 (Cortex-M4) only
+//#define CYCLE_PROFILE_ENABLE
 #define COMBO_COUNT 16
 #define  COMBO_TERM 20
 
@@ -29,8 +29,11 @@
  */
 
 #include QMK_KEYBOARD_H
+#ifdef RAW_ENABLE
+#include "raw_hid.h"
+#endif
+#include "usb_main.h"
 
-#include "muse.h"
 
 
 enum mode {
@@ -45,123 +48,366 @@ enum mode {
 
 
 
-#define HOLD_SHIFT register_mods(MOD_BIT(KC_LSFT))
-#define UNHOLD_SHIFT unregister_mods(MOD_BIT(KC_LSFT))
-#define HOLD_ALT register_mods(MOD_BIT(KC_LALT))
-#define UNHOLD_ALT unregister_mods(MOD_BIT(KC_LALT))
-#define HOLD_GUI register_mods(MOD_BIT(KC_LGUI))
-#define UNHOLD_GUI unregister_mods(MOD_BIT(KC_LGUI))
-#define HOLD_CTRL register_mods(MOD_BIT(KC_LCTRL))
-#define UNHOLD_CTRL unregister_mods(MOD_BIT(KC_LCTRL))
+#define HOLD_SHIFT hold_mods(MOD_BIT(KC_LSFT))
+#define UNHOLD_SHIFT unhold_mods(MOD_BIT(KC_LSFT))
+#define HOLD_ALT hold_mods(MOD_BIT(KC_LALT))
+#define UNHOLD_ALT unhold_mods(MOD_BIT(KC_LALT))
+#define HOLD_GUI hold_mods(MOD_BIT(KC_LGUI))
+#define UNHOLD_GUI unhold_mods(MOD_BIT(KC_LGUI))
+#define HOLD_CTRL hold_mods(MOD_BIT(KC_LCTRL))
+#define UNHOLD_CTRL unhold_mods(MOD_BIT(KC_LCTRL))
 #define ALT KC_LALT
 #define GUI KC_LGUI
 #define SHIFT KC_LSFT
-#define CTRL KC_LCTRL
+
+enum os_type {
+  OS_WIN,
+  OS_MAC,
+  OS_LINUX,
+};
+
+enum os_action {
+  OS_WORD_LEFT,
+  OS_WORD_RIGHT,
+  OS_LINE_START,
+  OS_LINE_END,
+  OS_DOC_START,
+  OS_DOC_END,
+  OS_COPY,
+  OS_PASTE,
+  OS_UNDO,
+  OS_REDO,
+  OS_FIND,
+  OS_FIND_NEXT,
+  OS_SAVE,
+  OS_CLOSE,
+  OS_GOTO_LINE, // KC_NO if there's no goto line shortcut, jumps fall back to doc start + downs
+  OS_ACTION_COUNT
+};
+
+typedef struct {
+  uint8_t  mods;
+  uint16_t keycode;
+} os_chord_t;
+
+#define OS_CTRL  MOD_BIT(KC_LCTRL)
+#define OS_ALT   MOD_BIT(KC_LALT)
+#define OS_GUI   MOD_BIT(KC_LGUI)
+#define OS_SHIFT MOD_BIT(KC_LSFT)
+
+const os_chord_t PROGMEM os_profiles[][OS_ACTION_COUNT] = {
+  [OS_WIN] = {
+    [OS_WORD_LEFT]  = {OS_CTRL, KC_LEFT},
+    [OS_WORD_RIGHT] = {OS_CTRL, KC_RIGHT},
+    [OS_LINE_START] = {0, KC_HOME},
+    [OS_LINE_END]   = {0, KC_END},
+    [OS_DOC_START]  = {OS_CTRL, KC_HOME},
+    [OS_DOC_END]    = {OS_CTRL, KC_END},
+    [OS_COPY]       = {OS_CTRL, KC_C},
+    [OS_PASTE]      = {OS_CTRL, KC_V},
+    [OS_UNDO]       = {OS_CTRL, KC_Z},
+    [OS_REDO]       = {OS_CTRL, KC_Y},
+    [OS_FIND]       = {OS_CTRL, KC_F},
+    [OS_FIND_NEXT]  = {0, KC_F3},
+    [OS_SAVE]       = {OS_CTRL, KC_S},
+    [OS_CLOSE]      = {OS_CTRL, KC_W},
+    [OS_GOTO_LINE]  = {OS_CTRL, KC_G},
+  },
+  [OS_MAC] = {
+    [OS_WORD_LEFT]  = {OS_ALT, KC_LEFT},
+    [OS_WORD_RIGHT] = {OS_ALT, KC_RIGHT},
+    [OS_LINE_START] = {OS_GUI, KC_LEFT},
+    [OS_LINE_END]   = {OS_GUI, KC_RIGHT},
+    [OS_DOC_START]  = {OS_GUI, KC_UP},
+    [OS_DOC_END]    = {OS_GUI, KC_DOWN},
+    [OS_COPY]       = {OS_GUI, KC_C},
+    [OS_PASTE]      = {OS_GUI, KC_V},
+    [OS_UNDO]       = {OS_GUI, KC_Z},
+    [OS_REDO]       = {OS_GUI | OS_SHIFT, KC_Z},
+    [OS_FIND]       = {OS_GUI, KC_F},
+    [OS_FIND_NEXT]  = {OS_GUI, KC_G},
+    [OS_SAVE]       = {OS_GUI, KC_S},
+    [OS_CLOSE]      = {OS_GUI, KC_W},
+    [OS_GOTO_LINE]  = {OS_CTRL, KC_G},
+  },
+  [OS_LINUX] = {
+    [OS_WORD_LEFT]  = {OS_CTRL, KC_LEFT},
+    [OS_WORD_RIGHT] = {OS_CTRL, KC_RIGHT},
+    [OS_LINE_START] = {0, KC_HOME},
+    [OS_LINE_END]   = {0, KC_END},
+    [OS_DOC_START]  = {OS_CTRL, KC_HOME},
+    [OS_DOC_END]    = {OS_CTRL, KC_END},
+    [OS_COPY]       = {OS_CTRL, KC_C},
+    [OS_PASTE]      = {OS_CTRL, KC_V},
+    [OS_UNDO]       = {OS_CTRL, KC_Z},
+    [OS_REDO]       = {OS_CTRL | OS_SHIFT, KC_Z},
+    [OS_FIND]       = {OS_CTRL, KC_F},
+    [OS_FIND_NEXT]  = {0, KC_F3},
+    [OS_SAVE]       = {OS_CTRL, KC_S},
+    [OS_CLOSE]      = {OS_CTRL, KC_W},
+    [OS_GOTO_LINE]  = {OS_CTRL, KC_G},
+  },
+};
 
 #define CMDBUFFSIZE 16
+#define LINE_NUM_MAX 32767
+#define LINE_BURST_MAX 500
 #define SAVEBUFFSIZE 16
 #define NO_CHAR '\0'
 
 
-bool visual_mode = false;
-int       currmode = INSERT_MODE;
-uint8_t   vim_layer;
-int       currcmdsize = 0;
-char      currcmd[CMDBUFFSIZE];
-int       savedcmdsize = 0;
-char      savedcmd[CMDBUFFSIZE];
-int       currsavesize = 0;
-uint16_t  saved_keycodes[SAVEBUFFSIZE];
-bool      saved_shiftstate[SAVEBUFFSIZE];
-bool      ismac = false;
+// All of the vim layer's state in one place, so it can be snapshotted and put back
+// with one copy. Wide fields first so there's no padding between them.
+typedef struct {
+  uint16_t saved_keycodes[SAVEBUFFSIZE];
+  uint16_t saved_shift;              // bit i set if saved_keycodes[i] was shifted
+  char     cmd[CMDBUFFSIZE];
+  char     savedcmd[CMDBUFFSIZE];
+  uint8_t  mode;                     // enum mode
+  bool     visual;
+  uint8_t  layer;
+  uint8_t  last_layer_on;
+  uint8_t  cmdsize;
+  uint8_t  savedcmdsize;
+  uint8_t  savesize;
+} vim_ctx_t;
+
+_Static_assert(SAVEBUFFSIZE <= 16, "saved_shift has one bit per saved keycode");
+_Static_assert(sizeof(vim_ctx_t) <= 80, "vim state budget");
+
+vim_ctx_t vim = { .mode = INSERT_MODE };
+vim_ctx_t vim_snapshot;
+const os_chord_t *os_profile = os_profiles[OS_WIN];
+uint8_t   mods_tx_depth = 0;
+uint8_t   mods_tx_sent;
+
+// Modifier transactions. Between mods_tx_begin() and mods_tx_end() the HOLD_/UNHOLD_
+// macros only change the mod state, nothing is sent until the next tap_key() (or the
+// end of the transaction) and then only if the mods differ from the last report.
+// So dropping shift around a command that types nothing costs no reports at all, and
+// going straight from shift to ctrl between two taps is one report instead of two.
+void mods_tx_flush(void) {
+  if (get_mods() != mods_tx_sent) {
+    send_keyboard_report();
+    mods_tx_sent = get_mods();
+  }
+}
 
-// If REPEAT_MODE (user used .)
-// just insert everything from buffer, then go back to command mode
-// else go insert mode
-void word_hold(void) {
-	if (ismac)
-		HOLD_ALT;
-	else
-		HOLD_CTRL;
-	return;
+void mods_tx_begin(void) {
+  if (mods_tx_depth++ == 0)
+    mods_tx_sent = get_mods();
 }
 
-void word_unhold(void) {
-	if (ismac)
-		UNHOLD_ALT;
-	else
-		UNHOLD_CTRL;
-	return;
+void mods_tx_end(void) {
+  if (--mods_tx_depth == 0)
+    mods_tx_flush();
 }
 
+void hold_mods(uint8_t mods) {
+  if (mods_tx_depth)
+    add_mods(mods);
+  else
+    register_mods(mods);
+}
 
+void unhold_mods(uint8_t mods) {
+  if (mods_tx_depth)
+    del_mods(mods);
+  else
+    unregister_mods(mods);
+}
 
+// Taps that would hold up the scan loop if they all went out at once queue here
+// and go out TAP_QUEUE_PER_SCAN per scan, each with the mods it had when it was
+// queued. Once anything is queued every tap_key() queues behind it so the order
+// stays the same. A run of the same tap is one entry. A key's taps go in whole or
+// not at all: tap_queue_begin() marks where the queue ends and if anything didn't
+// fit by tap_queue_end() everything after the mark comes back off, so an edit
+// never goes out with part of it missing (yy p x dw behind a 500j).
+typedef struct {
+  uint16_t count;
+  uint8_t  keycode;
+  uint8_t  mods;
+} queued_tap_t;
+
+queued_tap_t tap_queue[TAP_QUEUE_SIZE];
+uint8_t      tap_queue_head    = 0;
+uint8_t      tap_queue_len     = 0;
+bool         tap_queue_capture = false;
+bool         tap_queue_overflow = false; // a tap didn't fit since tap_queue_begin()
+uint8_t      tap_queue_mark_len;
+uint16_t     tap_queue_mark_count;       // of the last entry at the mark, taps merge into it
+
+void tap_enqueue(uint8_t keycode, uint8_t mods) {
+  if (tap_queue_overflow)
+    return;
+  if (tap_queue_len != 0) {
+    queued_tap_t *last = &tap_queue[(tap_queue_head + tap_queue_len - 1) % TAP_QUEUE_SIZE];
+    if (last->keycode == keycode && last->mods == mods && last->count != UINT16_MAX) {
+      last->count++;
+      return;
+    }
+  }
+  if (tap_queue_len == TAP_QUEUE_SIZE) {
+    tap_queue_overflow = true;
+    return;
+  }
+  tap_queue[(tap_queue_head + tap_queue_len++) % TAP_QUEUE_SIZE] = (queued_tap_t){ 1, keycode, mods };
+}
 
+void tap_queue_begin(void) {
+  tap_queue_overflow = false;
+  tap_queue_mark_len = tap_queue_len;
+  if (tap_queue_len != 0)
+    tap_queue_mark_count = tap_queue[(tap_queue_head + tap_queue_len - 1) % TAP_QUEUE_SIZE].count;
+}
+
+// false if the key's taps didn't fit and were taken back off
+bool tap_queue_end(void) {
+  if (!tap_queue_overflow)
+    return true;
+  tap_queue_overflow = false;
+  tap_queue_len      = tap_queue_mark_len;
+  if (tap_queue_len != 0)
+    tap_queue[(tap_queue_head + tap_queue_len - 1) % TAP_QUEUE_SIZE].count = tap_queue_mark_count;
+  return false;
+}
 
+void tap_queue_task(void) {
+  uint8_t budget = TAP_QUEUE_PER_SCAN;
+  while (budget != 0 && tap_queue_len != 0) {
+    queued_tap_t *t    = &tap_queue[tap_queue_head];
+    uint16_t      n    = t->count < budget ? t->count : budget;
+    uint8_t       mods = get_mods();
+    mods_tx_begin();
+    set_mods(t->mods);
+    mods_tx_flush();
+    for (uint16_t i = 0; i < n; i++)
+      tap_code(t->keycode);
+    set_mods(mods);
+    mods_tx_end();
+    budget   -= n;
+    t->count -= n;
+    if (t->count == 0) {
+      tap_queue_head = (tap_queue_head + 1) % TAP_QUEUE_SIZE;
+      tap_queue_len--;
+    }
+  }
+}
+
+void tap_key(uint16_t keycode) {
+  if (tap_queue_capture || tap_queue_len != 0) {
+    tap_enqueue(keycode, get_mods());
+    return;
+  }
+  if (mods_tx_depth)
+    mods_tx_flush();
+  tap_code(keycode);
+}
+
+// If REPEAT_MODE (user used .)
+// just insert everything from buffer, then go back to command mode
+// else go insert mode
 void go_insert_mode(void) {
-  if(currmode == REPEAT_MODE) { 
-    for(int i = 0; i < currsavesize; i++) {
-      if(saved_shiftstate[i]) HOLD_SHIFT;
-      tap_code(saved_keycodes[i]);
-      if(saved_shiftstate[i]) UNHOLD_SHIFT;
+  if(vim.mode == REPEAT_MODE) { 
+    for(int i = 0; i < vim.savesize; i++) {
+      bool shifted = vim.saved_shift & (1 << i);
+      if(shifted) HOLD_SHIFT;
+      tap_key(vim.saved_keycodes[i]);
+      if(shifted) UNHOLD_SHIFT;
     }
-    currmode = COMMAND_MODE;
+    vim.mode = COMMAND_MODE;
     return;
   }
-  savedcmdsize = currcmdsize;
-  memcpy(savedcmd, currcmd, CMDBUFFSIZE);
-  currcmdsize = 0;
-  currsavesize = 0;
-  currmode = INSERT_SAVE_MODE;
-  visual_mode = false;
+  vim.savedcmdsize = vim.cmdsize;
+  memcpy(vim.savedcmd, vim.cmd, CMDBUFFSIZE);
+  vim.cmdsize = 0;
+  vim.savesize = 0;
+  vim.mode = INSERT_SAVE_MODE;
+  vim.visual = false;
   layer_move(0);
 }
 
 void add_to_vim_cmd(char c) {
-  currcmd[currcmdsize++] = c;
-  currcmd[currcmdsize]   = NO_CHAR;
-  if(currcmdsize == CMDBUFFSIZE - 1)
+  if (vim.cmdsize == 0)
+    vim_snapshot = vim;
+  vim.cmd[vim.cmdsize++] = c;
+  vim.cmd[vim.cmdsize]   = NO_CHAR;
+  if(vim.cmdsize == CMDBUFFSIZE - 1)
     go_insert_mode();
 }
 
 void tap_code_num(uint16_t keycode, int num) {
   for (int i = 0; i < num; i++)
-    tap_code(keycode);
+    tap_key(keycode);
 }
 
+// only touch the mods that aren't already down, so a physically held one isn't let go
 void mod_type_num(uint16_t modcode, uint16_t keycode, int num) {
-  register_mods(MOD_BIT(modcode));
+  uint8_t mods = MOD_BIT(modcode) & ~get_mods();
+  hold_mods(mods);
   tap_code_num(keycode, num);
-  unregister_mods(MOD_BIT(modcode));
+  unhold_mods(mods);
 }
 
 void mod_type(uint16_t modcode, uint16_t keycode) {
   mod_type_num(modcode, keycode, 1);
 }
 
-void mod_os(uint16_t keycode){
-	if (ismac)
-            mod_type(GUI, keycode);
-	else
-            mod_type(CTRL, keycode);
-	return;
+// Everything the vim layer sends that differs between OSes goes through one of these
+// tables, picked once from the admin layer, so nothing checks the OS per keystroke.
+void os_tap_num(uint8_t action, int num) {
+  uint8_t mods = pgm_read_byte(&os_profile[action].mods) & ~get_mods();
+  hold_mods(mods);
+  tap_code_num(pgm_read_word(&os_profile[action].keycode), num);
+  unhold_mods(mods);
 }
-int get_prev_num(void) {
+
+void os_tap(uint8_t action) {
+  os_tap_num(action, 1);
+}
+
+// count made of the digits in vim.cmd up to and including last, capped at max
+int get_num(int last, int max) {
   int val = 0;
   int dec = 1;
-  for (int i = currcmdsize - 2; i >= 0; i--) {
-    char c = currcmd[i];
+  for (int i = last; i >= 0; i--) {
+    char c = vim.cmd[i];
     if (c >= '0' && c <= '9') {
+      // once dec is past the cap only zeros keep val in range, and
+      // stepping dec any further would overflow it (10000000000j)
+      if (dec > max) {
+        if (c != '0')
+          return max;
+        continue;
+      }
       val += (c - '0') * dec;
+      if (val > max)
+        return max;
       dec *= 10;
     }
   }
-  return val > 500 ? 500 : val;
+  return val;
+}
+
+int get_prev_num(void) {
+  return get_num(vim.cmdsize - 2, 500);
+}
+
+bool cmd_is_count_from(int first) {
+  for (int i = first; i < vim.cmdsize; i++)
+    if (vim.cmd[i] < '0' || vim.cmd[i] > '9')
+      return false;
+  return true;
+}
+
+bool cmd_is_count(void) {
+  return cmd_is_count_from(0);
 }
 
 char get_prev_char(void) {
-  for (int i = currcmdsize - 2; i >= 0; i--) {
-    char c = currcmd[i];
+  for (int i = vim.cmdsize - 2; i >= 0; i--) {
+    char c = vim.cmd[i];
     if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
       return c;
   }
@@ -170,8 +416,8 @@ char get_prev_char(void) {
 
 char get_2nd_prev_char(void) {
   bool first_found = false;
-  for (int i = currcmdsize - 2; i >= 0; i--) {
-    char c = currcmd[i];
+  for (int i = vim.cmdsize - 2; i >= 0; i--) {
+    char c = vim.cmd[i];
     if (!first_found && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')))
       first_found = true;
     else if (first_found && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')))
@@ -182,6 +428,100 @@ char get_2nd_prev_char(void) {
 
 void handle_vim_cmd(void);
 
+void tap_num(int num) {
+  if (num >= 10)
+    tap_num(num / 10);
+  tap_key(num % 10 == 0 ? KC_0 : KC_1 + num % 10 - 1);
+}
+
+// to the start of line from the top of the document, this is the path that can
+// extend a selection since a goto line box would drop it. The downs go through the
+// tap queue, and so does everything tapped after them until it has drained.
+// Further than LINE_BURST_MAX downs would hold the vim layer up for too long, those
+// lines aren't gone to at all rather than landing short with the wrong selection.
+bool line_burst_reaches(int line) {
+  return line - 1 <= LINE_BURST_MAX;
+}
+
+void line_burst(int line) {
+  if (!line_burst_reaches(line))
+    return;
+  bool capture      = tap_queue_capture;
+  tap_queue_capture = true;
+  os_tap(OS_DOC_START);
+  tap_code_num(KC_DOWN, line - 1);
+  tap_queue_capture = capture;
+}
+
+void goto_line(int line) {
+  if (pgm_read_word(&os_profile[OS_GOTO_LINE].keycode) == KC_NO) {
+    line_burst(line);
+    return;
+  }
+  os_tap(OS_GOTO_LINE);
+  tap_num(line);
+  tap_key(KC_ENT);
+}
+
+// G and gg, with a count they go to that line instead of the end/start of the document.
+// op is the operator in front (d, c, y, x, X) if any
+void goto_cmd(char op, int line, uint8_t doc_action) {
+  if (op == 'd' || op == 'x' || op == 'X' || op == 'c' || op == 'y') {
+    if (!line_burst_reaches(line))
+      return;
+    HOLD_SHIFT;
+    if (line == 0)
+      os_tap(doc_action);
+    else
+      line_burst(line);
+    UNHOLD_SHIFT;
+    if (op == 'c' || op == 'd')
+      tap_key(KC_DEL);
+    if (op == 'c')
+      go_insert_mode();
+    if (op == 'y') {
+      os_tap(OS_COPY);
+      if (doc_action == OS_DOC_START) {
+        tap_key(KC_RIGHT);
+        tap_key(KC_LEFT);
+      } else {
+        tap_key(KC_LEFT);
+        tap_key(KC_RIGHT);
+      }
+    }
+  } else {
+    if(vim.visual) HOLD_SHIFT;
+    if (line == 0)
+      os_tap(doc_action);
+    else if (vim.visual)
+      line_burst(line);
+    else
+      goto_line(line);
+    if(vim.visual) UNHOLD_SHIFT;
+  }
+}
+
+bool is_ex_cmd(void) {
+  return vim.cmdsize > 0 && (vim.cmd[0] == ':' || vim.cmd[0] == ';');
+}
+
+// :{n}, :w, :q and :wq, run on enter
+void run_ex_cmd(void) {
+  mods_tx_begin();
+  if (vim.cmdsize > 1 && cmd_is_count_from(1)) {
+    goto_line(get_num(vim.cmdsize - 1, LINE_NUM_MAX));
+  } else if (vim.cmdsize == 2 && vim.cmd[1] == 'w') {
+    os_tap(OS_SAVE);
+  } else if (vim.cmdsize == 2 && vim.cmd[1] == 'q') {
+    os_tap(OS_CLOSE);
+  } else if (vim.cmdsize == 3 && vim.cmd[1] == 'w' && vim.cmd[2] == 'q') {
+    os_tap(OS_SAVE);
+    os_tap(OS_CLOSE);
+  }
+  mods_tx_end();
+  vim.cmdsize = 0;
+}
+
 bool handle_cmd(char last_char, char prev_char, int num) {
   uint16_t direction = KC_RIGHT;
   if (num == 0) num = 1;
@@ -204,18 +544,18 @@ bool handle_cmd(char last_char, char prev_char, int num) {
         case 'y':
           mod_type_num(SHIFT, direction, num);
           if (prev_char == 'y') {
-            mod_os( KC_C);
-            tap_code(KC_LEFT);
-            tap_code(KC_RIGHT);
+            os_tap(OS_COPY);
+            tap_key(KC_LEFT);
+            tap_key(KC_RIGHT);
           }
-          tap_code(KC_DEL);
+          tap_key(KC_DEL);
           if (prev_char == 'c')
             go_insert_mode();
           break;
         default:
-          if(visual_mode) HOLD_SHIFT;
+          if(vim.visual) HOLD_SHIFT;
           tap_code_num(direction, num);
-          if(visual_mode) UNHOLD_SHIFT;
+          if(vim.visual) UNHOLD_SHIFT;
           break;
       }
       return true;
@@ -226,137 +566,126 @@ bool handle_cmd(char last_char, char prev_char, int num) {
         case 'd':
         case 'c':
         case 'y':
-          word_hold();
           HOLD_SHIFT;
-          tap_code_num(KC_RIGHT, num);
+          os_tap_num(OS_WORD_RIGHT, num);
           // e vs w, going one further and then back again works in both word and
           // mac apps. Will not work well if this is the last word in the document however
 
-          word_unhold();
           UNHOLD_SHIFT;
 
           // yw, ye, copy
           if (prev_char == 'y') {
-	    mod_os(KC_C);
-            tap_code(KC_LEFT);
-            tap_code(KC_RIGHT);
+	    os_tap(OS_COPY);
+            tap_key(KC_LEFT);
+            tap_key(KC_RIGHT);
           } else {
-            tap_code(KC_DEL);
+            tap_key(KC_DEL);
           }
           // cw, ce leave go insert mode
           if (prev_char == 'c')
             go_insert_mode();
-
-          // :w is save
-          if (prev_char == ';' && last_char == 'w' && num == 1) {
-            mod_os(KC_S);
-          }
           return true;
 
         // Just w or e
         default:
-          if(visual_mode) HOLD_SHIFT;
-          mod_type_num(CTRL, KC_RIGHT, num);
-          
-          if(visual_mode) UNHOLD_SHIFT;
+          if(vim.visual) HOLD_SHIFT;
+          os_tap_num(OS_WORD_RIGHT, num);
+          if(vim.visual) UNHOLD_SHIFT;
           return true;
       }
 
     case 'v':
-      if(visual_mode) {
-        visual_mode = false;
-        tap_code(KC_RIGHT);
-        tap_code(KC_LEFT);
+      if(vim.visual) {
+        vim.visual = false;
+        tap_key(KC_RIGHT);
+        tap_key(KC_LEFT);
       } else {
-        visual_mode = true;
+        vim.visual = true;
       }
       return true;
 
     case 'a':
-      tap_code(KC_RIGHT);
+      tap_key(KC_RIGHT);
     case 'i':
       go_insert_mode();
       return true;
 
     case '/':
-      mod_os( KC_F);
+      os_tap(OS_FIND);
       go_insert_mode();
       return true;
 
     case 'u':
-      mod_os( KC_Z);
+      os_tap(OS_UNDO);
       return true;
 
     case 'o':
-      tap_code(KC_END);
-      tap_code(KC_ENT);
+      os_tap(OS_LINE_END);
+      tap_key(KC_ENT);
       go_insert_mode();
       return true;
 
     case 'D':
     case 'C':
-      HOLD_GUI;
-      mod_type(SHIFT, KC_RIGHT);
-      UNHOLD_GUI;
-      tap_code(KC_DEL);
-      if (last_char == 'c')
+      HOLD_SHIFT;
+      os_tap(OS_LINE_END);
+      UNHOLD_SHIFT;
+      tap_key(KC_DEL);
+      if (last_char == 'C')
         go_insert_mode();
       return true;
 
     case 'I':
-      mod_os( KC_LEFT);
+      os_tap(OS_LINE_START);
       go_insert_mode();
       return true;
 
     case 'A':
-      mod_os( KC_RIGHT);
+      os_tap(OS_LINE_END);
       go_insert_mode();
       break;
 
     case 'O':
-      tap_code(KC_UP);
-      tap_code(KC_END);
-      tap_code(KC_ENT);
+      tap_key(KC_UP);
+      os_tap(OS_LINE_END);
+      tap_key(KC_ENT);
       go_insert_mode();
       return true;
 
     case 'p':
-      mod_os( KC_V);
+      os_tap(OS_PASTE);
       return true;
 
     case 'n':
-      mod_os( KC_G);
+      os_tap(OS_FIND_NEXT);
       return true;
 
     // This is a special case. In vi(m) p either pastes a new line or at the cursor depending
     // on what's in the paste buffer. I can't do that. So p and \ (button right of p) acts
     // as these two cases
     case '\\':
-      mod_os( KC_END);
-      tap_code(KC_ENT);
-      mod_os( KC_V);
+      os_tap(OS_LINE_END);
+      tap_key(KC_ENT);
+      os_tap(OS_PASTE);
       return true;
 
     case 'q':
-      // :q is save
-      if (prev_char == ';' && num == 1) {
-        mod_os( KC_W);
-      }
+      // no macros, :q is handled by run_ex_cmd
       return true;
 
     case 'b':
       switch (prev_char) {
         case 'd':
           HOLD_SHIFT;
-          mod_type_num(CTRL, KC_LEFT, num);
+          os_tap_num(OS_WORD_LEFT, num);
           UNHOLD_SHIFT;
-          tap_code(KC_DEL);
+          tap_key(KC_DEL);
           break;
 
         default:
-          if(visual_mode) HOLD_SHIFT;
-          mod_type_num(CTRL, KC_LEFT, num);
-          if(visual_mode) UNHOLD_SHIFT;
+          if(vim.visual) HOLD_SHIFT;
+          os_tap_num(OS_WORD_LEFT, num);
+          if(vim.visual) UNHOLD_SHIFT;
           break;
       }
       return true;
@@ -364,13 +693,15 @@ bool handle_cmd(char last_char, char prev_char, int num) {
     case 'd':
       switch (prev_char) {
         case 'd':
-          tap_code(KC_HOME);
-          mod_type_num(SHIFT, KC_END, num);
-          tap_code(KC_DEL);
+          os_tap(OS_LINE_START);
+          HOLD_SHIFT;
+          os_tap_num(OS_LINE_END, num);
+          UNHOLD_SHIFT;
+          tap_key(KC_DEL);
           return true;
         case NO_CHAR:
-          if(visual_mode) {
-            visual_mode = false;
+          if(vim.visual) {
+            vim.visual = false;
             num = 1;
             tap_code_num(KC_DEL, num);
             return true;
@@ -381,33 +712,35 @@ bool handle_cmd(char last_char, char prev_char, int num) {
     case 'y':
       switch (prev_char) {
         case 'y':
-          tap_code(KC_HOME);
-          mod_type_num(SHIFT, KC_END, num);
-          mod_os( KC_C);
-          tap_code(KC_RIGHT);
-          tap_code(KC_LEFT);
+          os_tap(OS_LINE_START);
+          HOLD_SHIFT;
+          os_tap_num(OS_LINE_END, num);
+          UNHOLD_SHIFT;
+          os_tap(OS_COPY);
+          tap_key(KC_RIGHT);
+          tap_key(KC_LEFT);
           return true;
         default:
-          if(visual_mode) {
-            visual_mode = false;
-            mod_os( KC_C);
-            tap_code(KC_LEFT);
+          if(vim.visual) {
+            vim.visual = false;
+            os_tap(OS_COPY);
+            tap_key(KC_LEFT);
             return true;
           }
       }
       return false;
 
     case 'x':
-      if(visual_mode) {
-        visual_mode = false;
+      if(vim.visual) {
+        vim.visual = false;
         num = 1;
       }
       tap_code_num(KC_DEL, num);
       return true;
 
     case 'X':
-      if(visual_mode) {
-        visual_mode = false;
+      if(vim.visual) {
+        vim.visual = false;
         num = 1;
       }
       tap_code_num(KC_BSPACE, num);
@@ -415,11 +748,11 @@ bool handle_cmd(char last_char, char prev_char, int num) {
 
     case '0':
     case '^':
-      if (currcmdsize != 1)
+      if (vim.cmdsize != 1)
         return false;
-      if(visual_mode) HOLD_SHIFT;
-      tap_code(KC_HOME);
-      if(visual_mode) UNHOLD_SHIFT;
+      if(vim.visual) HOLD_SHIFT;
+      os_tap(OS_LINE_START);
+      if(vim.visual) UNHOLD_SHIFT;
       return true;
 
     case '$':
@@ -427,15 +760,17 @@ bool handle_cmd(char last_char, char prev_char, int num) {
         case 'd':
         case 'c':
         case 'y':
-          mod_type(SHIFT, KC_HOME);
+          HOLD_SHIFT;
+          os_tap(OS_LINE_END);
+          UNHOLD_SHIFT;
           if (prev_char == 'y') {
-            mod_os( KC_C);
-            tap_code(KC_LEFT);
-            tap_code(KC_RIGHT);
-            tap_code(KC_LEFT);
-            visual_mode = false;
+            os_tap(OS_COPY);
+            tap_key(KC_LEFT);
+            tap_key(KC_RIGHT);
+            tap_key(KC_LEFT);
+            vim.visual = false;
           } else {
-            tap_code(KC_DEL);
+            tap_key(KC_DEL);
             if (prev_char == 'c')
               go_insert_mode();
           }
@@ -444,72 +779,38 @@ bool handle_cmd(char last_char, char prev_char, int num) {
           
 
         default:
-          if(visual_mode) HOLD_SHIFT;
-          tap_code(KC_END);
-          if(visual_mode) UNHOLD_SHIFT;
+          if(vim.visual) HOLD_SHIFT;
+          os_tap(OS_LINE_END);
+          if(vim.visual) UNHOLD_SHIFT;
           return true;
       }
       return true;
 
     case 'G':
-      if(prev_char == 'd' || prev_char == 'x' || prev_char == 'X' || prev_char == 'c' || prev_char == 'y') {
-        HOLD_SHIFT;
-        mod_os( KC_END);
-        UNHOLD_SHIFT;
-        if (prev_char == 'c' || prev_char == 'd')
-          tap_code(KC_DEL);
-        if (prev_char == 'c')
-          go_insert_mode();
-        if (prev_char == 'y') {
-          mod_os( KC_C);
-          tap_code(KC_LEFT);
-          tap_code(KC_RIGHT);
-        }
-      } else {
-        if(visual_mode) HOLD_SHIFT;
-        mod_os( KC_END);
-        if(visual_mode) UNHOLD_SHIFT;
-      }
+      goto_cmd(prev_char, get_num(vim.cmdsize - 2, LINE_NUM_MAX), OS_DOC_END);
       return true;
 
     case 'g':
       if (prev_char == 'g') {
-        char ch2 = get_2nd_prev_char();
-        if(ch2 == 'd' || ch2 == 'x' || ch2 == 'X' || ch2 == 'c' || ch2 == 'y') {
-          HOLD_SHIFT;
-          mod_os( KC_HOME);
-          UNHOLD_SHIFT;
-          if (ch2 == 'c' || ch2 == 'd')
-            tap_code(KC_DEL);
-          if (ch2 == 'c')
-            go_insert_mode();
-          if (ch2 == 'y') {
-            mod_os( KC_C);
-            tap_code(KC_RIGHT);
-            tap_code(KC_LEFT);
-          }
-        } else {
-          if(visual_mode) HOLD_SHIFT;
-          mod_os( KC_HOME);
-          if(visual_mode) UNHOLD_SHIFT;
-        }
+        goto_cmd(get_2nd_prev_char(), get_num(vim.cmdsize - 2, LINE_NUM_MAX), OS_DOC_START);
+        return true;
       }
       return false;
 
     case 'r':
-      tap_code(KC_DEL);
-      currcmdsize = 0;
-      visual_mode = false;
-      currmode = REPLACE_MODE_INIT;
+      tap_key(KC_DEL);
+      vim.cmdsize = 0;
+      vim.visual = false;
+      vim.mode = REPLACE_MODE_INIT;
       return true;
 
     case '.':
-      if(savedcmdsize != 0) {
-        currmode = REPEAT_MODE;
-        currcmdsize = savedcmdsize;
-        memcpy(currcmd, savedcmd, CMDBUFFSIZE);
+      if(vim.savedcmdsize != 0) {
+        vim.mode = REPEAT_MODE;
+        vim.cmdsize = vim.savedcmdsize;
+        memcpy(vim.cmd, vim.savedcmd, CMDBUFFSIZE);
         handle_vim_cmd();
-        currcmdsize = 0;
+        vim.cmdsize = 0;
       }
       return true;
   }
@@ -541,11 +842,12 @@ char keycode_to_char(uint16_t keycode, keyrecord_t *record) {
     return '$';
   if (keycode == KC_CIRC)
     return '^';
-  if (SHIFT_HELD) {
-    return keycode_to_char_map_shifted[keycode];
-  }
+  if (keycode == KC_COLN)
+    return ':';
   if(keycode < KC_A || keycode > KC_SLASH)
     return NO_CHAR;
+  if (SHIFT_HELD)
+    return keycode_to_char_map_shifted[keycode];
   return keycode_to_char_map[keycode];
 }
 
@@ -647,11 +949,23 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
                                 KC_TAB, KC_Q, KC_W, KC_E, KC_R, KC_T, KC_Y, KC_U, KC_I, KC_O, KC_P, KC_BSPC, 
                                  KC_LSFT, KC_A, KC_S, KC_D, KC_F, KC_G, KC_H, KC_J, KC_K, KC_L, KC_QUOT, KC_ENT,
                                   KC_LCTL, KC_Z, KC_X, KC_C, KC_V, KC_B, KC_SPC,KC_ESC, TT(3), TT(3), TT(4), TO(0)),
-        [7] = LAYOUT_ortho_4x12(TO(0), RESET,KC_MS_U, KC_MS_D,KC_TRNS, KC_PGUP, KC_PGUP, KC_AMPR, KC_ASTR, KC_LPRN, KC_HOME, KC_END, 
+        [7] = LAYOUT_ortho_4x12(TO(0), RESET,KC_MS_U, KC_MS_D,TO(8), KC_PGUP, KC_PGUP, KC_AMPR, KC_ASTR, KC_LPRN, KC_HOME, KC_END, 
                                  KC_TRNS, KC_MS_L, KC_MS_D, KC_MS_R, KC_WH_L, KC_WH_U,KC_WH_R, KC_DOWN, KC_UP, KC_RGHT, KC_RCBR, KC_PIPE,
                                   KC_BTN1, KC_ACL0  , KC_ACL1, KC_ACL2, KC_F10, KC_WH_D, KC_VOLU, KC_VOLD, KC_MUTE,KC_MPRV , KC_MNXT, KC_MPLY,
                                   KC_LCTL, KC_LGUI, KC_LALT, TT(1), KC_BTN2, KC_SPC, KC_SPC, KC_ESC, TT(3), TT(3), TT(4), KC_SLSH),
 
+#ifdef STENO_ENABLE
+        [8] = LAYOUT_ortho_4x12(STN_N1, STN_N2, STN_N3, STN_N4, STN_N5, STN_N6, STN_N7, STN_N8, STN_N9, STN_NA, STN_NB, STN_NC,
+                                STN_FN, STN_S1, STN_TL, STN_PL, STN_HL, STN_ST1, STN_ST3, STN_FR, STN_PR, STN_LR, STN_TR, STN_DR,
+                                 STN_PWR, STN_S2, STN_KL, STN_WL, STN_RL, STN_ST2, STN_ST4, STN_RR, STN_BR, STN_GR, STN_SR, STN_ZR,
+                                  TO(0), KC_NO, KC_NO, STN_A, STN_O, KC_NO, KC_NO, STN_E, STN_U, KC_NO, KC_NO, KC_NO),
+#else
+        [8] = LAYOUT_ortho_4x12(KC_1, KC_1, KC_1, KC_1, KC_1, KC_1, KC_1, KC_1, KC_1, KC_1, KC_1, KC_1,
+                                KC_NO, KC_Q, KC_W, KC_E, KC_R, KC_T, KC_Y, KC_U, KC_I, KC_O, KC_P, KC_LBRC,
+                                 KC_NO, KC_A, KC_S, KC_D, KC_F, KC_G, KC_H, KC_J, KC_K, KC_L, KC_SCLN, KC_QUOT,
+                                  TO(0), KC_NO, KC_NO, KC_C, KC_V, KC_NO, KC_NO, KC_N, KC_M, KC_NO, KC_NO, KC_NO),
+#endif
+
 };
 
 
@@ -698,79 +1012,293 @@ combo_t key_combos[COMBO_COUNT] = {
 
 
 #ifdef AUDIO_ENABLE
+  float startup_song_late[][2] = SONG(PLANCK_SOUND);
   float plover_song[][2]     = SONG(PLOVER_SOUND);
   float plover_gb_song[][2]  = SONG(PLOVER_GOODBYE_SOUND);
   float numpad_song[][2] = SONG(NUM_LOCK_ON_SOUND);
 #endif
 
 
-bool muse_mode = false;
-uint8_t last_muse_note = 0;
-uint16_t muse_counter = 0;
-uint8_t muse_offset = 70;
-uint16_t muse_tempo = 50;
 
-static uint8_t last_layer_on = 0;
+// CS layer: while layer 6 is the only layer on, keys skip the vim and admin handling
+// in process_record_user and the layer hook, and RGB animation / audio are parked
+#define GAMING_LAYER_STATE ((layer_state_t)1 << 6)
+bool    gaming_mode = false;
+uint8_t gaming_saved_rgb_mode;
+
+void gaming_mode_on(void) {
+  gaming_mode = true;
+  gaming_saved_rgb_mode = rgblight_get_mode();
+  rgblight_mode_noeeprom(RGBLIGHT_MODE_STATIC_LIGHT);
+#ifdef AUDIO_ENABLE
+  stop_all_notes();
+#endif
+}
+
+void gaming_mode_off(void) {
+  gaming_mode = false;
+  rgblight_mode_noeeprom(gaming_saved_rgb_mode);
+}
+
+// Steno layer (8), from the admin layer. Chords go out as GeminiPR over the virtual
+// serial port, QMK's steno code does the chord buffering and all-keys-up detection.
+// The protocol is set once at startup, steno_set_mode goes to eeprom.
+// Without STENO_ENABLE the layer is plain qwerty for Plover's keyboard mode with NKRO.
+// Either way combos and vim are off while it's up.
+bool steno_active = false;
+#if !defined(STENO_ENABLE) && defined(NKRO_ENABLE)
+bool steno_saved_nkro;
+#endif
+
+void steno_layer_on(void) {
+  steno_active = true;
+  combo_disable();
+#if !defined(STENO_ENABLE) && defined(NKRO_ENABLE)
+  // nothing can be left down in a 6KRO report when it switches to NKRO
+  clear_keyboard();
+  steno_saved_nkro = keymap_config.nkro;
+  keymap_config.nkro = true;
+#endif
+#ifdef AUDIO_ENABLE
+  PLAY_SONG(plover_song);
+#endif
+}
+
+void steno_layer_off(void) {
+  steno_active = false;
+#if !defined(STENO_ENABLE) && defined(NKRO_ENABLE)
+  clear_keyboard();
+  keymap_config.nkro = steno_saved_nkro;
+#endif
+#ifdef AUDIO_ENABLE
+  PLAY_SONG(plover_gb_song);
+#endif
+}
+
+// the colour for each layer that can be vim.last_layer_on, 2 and 5 never are
+const uint8_t PROGMEM layer_colours[][3] = {
+  [0] = { 250, 255, 255 },
+  [1] = {   0,   0, 255 },
+  [3] = {   0, 255,   0 },
+  [4] = {  59, 255,   0 },
+  [6] = {   0, 255, 255 },
+  [7] = {   0,   0, 255 },
+  [8] = { 255,   0, 255 },
+};
+
+void set_layer_colour(uint8_t layer) {
+  rgblight_setrgb(pgm_read_byte(&layer_colours[layer][0]), pgm_read_byte(&layer_colours[layer][1]), pgm_read_byte(&layer_colours[layer][2]));
+}
 
 layer_state_t layer_state_set_user(layer_state_t state) {
-    if (layer_state_cmp(state,0) && last_layer_on !=0){
-          rgblight_setrgb(250, 255,255) ;
-          last_layer_on=0;
-          currmode = INSERT_MODE;
+    if (gaming_mode) {
+      if (state == GAMING_LAYER_STATE)
+        return state;
+      gaming_mode_off();
+    }
+
+    if (layer_state_cmp(state,0) && vim.last_layer_on !=0){
+          if (steno_active)
+            steno_layer_off();
+          set_layer_colour(0);
+          vim.last_layer_on=0;
+          vim.mode = INSERT_MODE;
           combo_enable();
     }
     
-    if (layer_state_cmp(state,1) && last_layer_on !=1){
-          rgblight_setrgb(0,0,255) ;
-          last_layer_on=1;    
+    if (layer_state_cmp(state,1) && vim.last_layer_on !=1){
+          set_layer_colour(1);
+          vim.last_layer_on=1;    
     }
 
-   if (layer_state_cmp(state,3) && last_layer_on !=3){
-          rgblight_setrgb(0,255,0) ;
-          last_layer_on=  3;    
-          currmode = COMMAND_MODE;
+   if (layer_state_cmp(state,3) && vim.last_layer_on !=3){
+          set_layer_colour(3);
+          vim.last_layer_on=  3;    
+          vim.mode = COMMAND_MODE;
     }
    
-  if (layer_state_cmp(state,4) && last_layer_on !=4){
-          rgblight_setrgb( 59,255,0) ;
-          last_layer_on= 4;    
+  if (layer_state_cmp(state,4) && vim.last_layer_on !=4){
+          set_layer_colour(4);
+          vim.last_layer_on= 4;    
     }
 
-  if (layer_state_cmp(state,6) && last_layer_on !=6){
-          rgblight_setrgb( 0,255,255) ;
-          last_layer_on= 6;
+  if (layer_state_cmp(state,6) && vim.last_layer_on !=6){
+          // before setrgb, changing mode reloads the colour from eeprom
+          if (state == GAMING_LAYER_STATE)
+            gaming_mode_on();
+          set_layer_colour(6);
+          vim.last_layer_on= 6;
           combo_disable();    
     }
 
-if (layer_state_cmp(state,7) && last_layer_on !=7){
-          rgblight_setrgb( 0,0,255) ;
-          last_layer_on= 7;
+if (layer_state_cmp(state,7) && vim.last_layer_on !=7){
+          set_layer_colour(7);
+          vim.last_layer_on= 7;
           combo_disable();    
     }
+if (layer_state_cmp(state,8) && vim.last_layer_on !=8){
+          set_layer_colour(8);
+          vim.last_layer_on= 8;
+          steno_layer_on();
+    }
     return state;
  
 
 }
 
 
+// Held motions repeat from here rather than leaning on the host's autorepeat: the
+// first repeat comes after VIM_REPEAT_DELAY, then the gap shrinks by
+// VIM_REPEAT_ACCEL each time down to VIM_REPEAT_MIN. Every step's taps go through
+// the tap queue with the mods they need, and the next step isn't due until the
+// queue has emptied, so a big count can't block the scan loop or pile up.
+uint16_t repeat_keycode = 0;
+int      repeat_num;
+uint16_t repeat_timer;
+uint16_t repeat_interval;
+
+bool held_motion_tap(uint16_t keycode, int num) {
+  bool shift = vim.visual && !SHIFT_HELD;
+  tap_queue_capture = true;
+  mods_tx_begin();
+  if (shift) HOLD_SHIFT;
+  switch (keycode) {
+    case KC_H:
+      tap_code_num(KC_LEFT, num);
+      break;
+    case KC_J:
+      tap_code_num(KC_DOWN, num);
+      break;
+    case KC_K:
+      tap_code_num(KC_UP, num);
+      break;
+    case KC_L:
+      tap_code_num(KC_RIGHT, num);
+      break;
+    case KC_W:
+    case KC_E:
+      os_tap_num(OS_WORD_RIGHT, num);
+      break;
+    case KC_B:
+      os_tap_num(OS_WORD_LEFT, num);
+      break;
+    default:
+      keycode = 0;
+  }
+  if (shift) UNHOLD_SHIFT;
+  mods_tx_end();
+  tap_queue_capture = false;
+  return keycode != 0;
+}
+
+bool held_motion(uint16_t keycode, int num) {
+  if (!held_motion_tap(keycode, num))
+    return false;
+  repeat_keycode  = keycode;
+  repeat_num      = num;
+  repeat_timer    = timer_read();
+  repeat_interval = VIM_REPEAT_DELAY;
+  return true;
+}
+
+void held_motion_task(void) {
+  if (repeat_keycode == 0)
+    return;
+  if (vim.mode != COMMAND_MODE) {
+    repeat_keycode = 0;
+    return;
+  }
+  if (tap_queue_len != 0 || timer_elapsed(repeat_timer) < repeat_interval)
+    return;
+  held_motion_tap(repeat_keycode, repeat_num);
+  repeat_timer = timer_read();
+  if (repeat_interval == VIM_REPEAT_DELAY)
+    repeat_interval = VIM_REPEAT_INTERVAL;
+  else if (repeat_interval > VIM_REPEAT_MIN + VIM_REPEAT_ACCEL)
+    repeat_interval -= VIM_REPEAT_ACCEL;
+  else
+    repeat_interval = VIM_REPEAT_MIN;
+}
+
 void handle_vim_cmd(void) {
-  char last_char = currcmd[currcmdsize - 1];
+  char last_char = vim.cmd[vim.cmdsize - 1];
   char prev_char = get_prev_char();
   int  prev_num  = get_prev_num();
   bool lshift    = L_SHIFT_HELD;
   bool rshift    = R_SHIFT_HELD;
+  mods_tx_begin();
   if (lshift) UNHOLD_SHIFT;
-  if (rshift) unregister_mods(MOD_BIT(KC_RSFT));
+  if (rshift) unhold_mods(MOD_BIT(KC_RSFT));
 
   if (handle_cmd(last_char, prev_char, prev_num))
-    currcmdsize = 0;
+    vim.cmdsize = 0;
 
   if (lshift) HOLD_SHIFT;
-  if (rshift) register_mods(MOD_BIT(KC_RSFT));
+  if (rshift) hold_mods(MOD_BIT(KC_RSFT));
+  mods_tx_end();
 }
 
+// Hints from a host agent over raw HID, so the vim layer doesn't have to guess
+// what has focus. Packet: [0] = VIM_HINT_ID, [1] = hint. Each hint is a couple of
+// assignments, applied as it arrives; the reply echoes the packet with [2..4] set
+// to vim.mode, vim.visual and vim_passthrough.
+enum vim_hint {
+  HINT_TEXT_FIELD = 1, // plain text field focused, emulate vim
+  HINT_TERMINAL_VIM,   // real vim has focus, pass keys straight through
+  HINT_SELECTION_ON,
+  HINT_SELECTION_OFF,
+  HINT_RESET,          // drop whatever command was half typed
+};
+
+#define VIM_HINT_ID 'v'
+
+bool vim_passthrough = false;
+
+#ifdef RAW_ENABLE
+void raw_hid_receive(uint8_t *data, uint8_t length) {
+  if (length < 5 || data[0] != VIM_HINT_ID)
+    return;
+
+  switch (data[1]) {
+    case HINT_TEXT_FIELD:
+      vim_passthrough = false;
+      vim.cmdsize = 0;
+      break;
+    case HINT_TERMINAL_VIM:
+      vim_passthrough = true;
+      vim.visual = false;
+      vim.cmdsize = 0;
+      repeat_keycode = 0;
+      break;
+    case HINT_SELECTION_ON:
+      vim.visual = true;
+      break;
+    case HINT_SELECTION_OFF:
+      vim.visual = false;
+      break;
+    case HINT_RESET:
+      vim.cmdsize = 0;
+      repeat_keycode = 0;
+      break;
+  }
+
+  data[2] = vim.mode;
+  data[3] = vim.visual;
+  data[4] = vim_passthrough;
+  raw_hid_send(data, length);
+}
+#endif
+
 bool handle_vim_mode(uint16_t keycode, keyrecord_t *record, uint8_t vim_layer_no) {
-  if (currmode == COMMAND_MODE) {
+  if (vim_passthrough) {
+    if (keycode != VIM_ESC)
+      return false;
+    if (record->event.pressed)
+      tap_code(KC_ESC);
+    return true;
+  }
+
+  if (vim.mode == COMMAND_MODE) {
     switch (keycode) {
       case KC_LALT:
       case KC_LSHIFT:
@@ -783,112 +1311,86 @@ bool handle_vim_mode(uint16_t keycode, keyrecord_t *record, uint8_t vim_layer_no
       case KC_ESC:
         return false;
       case VIM_NUM:
-        if (record->event.pressed){
+        // layer 5 has no branch in layer_state_set_user, so vim.last_layer_on stays 3
+        // for the whole hop and coming back doesn't reset the command
+        if (record->event.pressed)
           layer_move(5);
-          last_layer_on=5;
-        } else {
+        else
           layer_move(3);
-          last_layer_on=3;
-        }
         return false;
       case TO(0):
         go_insert_mode();
         return true;
     }
 
-    if (currcmdsize == 0) {
-      // This takes care of holding down one of hjklwbe
-      uint16_t newKey = 0;
-      switch(keycode) {
-        case KC_H:
-          newKey = KC_LEFT;
-          break;
-        case KC_J:
-          newKey = KC_DOWN;
-          break;
-        case KC_K:
-          newKey = KC_UP;
-          break;
-        case KC_L:
-          newKey = KC_RIGHT;
-          break;
-        case KC_W:
-          if(record->event.pressed)
-            word_hold();
-          else
-            word_unhold();
-          newKey = KC_RIGHT;
-          break;
-        case KC_E:
-          if(record->event.pressed)
-            HOLD_CTRL;
-          else
-            UNHOLD_CTRL;
-          newKey = KC_RIGHT;
-          break;
-        case KC_B:
-          if(record->event.pressed)
-            word_hold();
-          else
-            word_unhold();
-          newKey = KC_LEFT;
-          break;
-      }
-      if(newKey != 0) {
-        if(record->event.pressed) {
-          if(visual_mode)
-            HOLD_SHIFT; 
-          register_code(newKey);
-        } else {
-          unregister_code(newKey);
-          if(keycode == KC_W) {
-	    word_hold();
-	    register_code(keycode);
-	    word_unhold();
-          }
-          if(visual_mode)
-            UNHOLD_SHIFT;
-        }
+    // like host autorepeat, the repeat stops on release or when anything else is pressed
+    if (record->event.pressed) {
+      repeat_keycode = 0;
+    } else if (keycode == repeat_keycode) {
+      repeat_keycode = 0;
+      return true;
+    }
+
+    if (record->event.pressed && cmd_is_count()) {
+      // This takes care of holding down one of hjklwbe, with or without a count
+      int num = get_num(vim.cmdsize - 1, 500);
+      if (held_motion(keycode, num == 0 ? 1 : num)) {
+        vim.cmdsize = 0;
         return true;
       }
     }
   }
 
-  if(currmode == REPLACE_MODE_INIT) {
-    currmode = REPLACE_MODE;
+  if(vim.mode == REPLACE_MODE_INIT) {
+    vim.mode = REPLACE_MODE;
     return true;
   } else
-  if(currmode == REPLACE_MODE) {
-    if (!record->event.pressed) {
-      currmode = COMMAND_MODE;
+  if(vim.mode == REPLACE_MODE) {
+    // The replacement goes through to core. A basic key's release follows it
+    // there by way of core_key_release and never gets back here, so replace mode
+    // ends on its press. A mod doesn't end it, anything else ends it on release.
+    if (record->event.pressed ? keycode <= 0xFF && !(keycode >= KC_LCTRL && keycode <= KC_RGUI)
+                              : keycode > 0xFF) {
+      vim.mode = COMMAND_MODE;
     }
     return false;
   }
 
   if (!record->event.pressed)
-    return currmode != INSERT_MODE && currmode != INSERT_SAVE_MODE;
+    return vim.mode != INSERT_MODE && vim.mode != INSERT_SAVE_MODE;
 
-  vim_layer = vim_layer_no;
+  vim.layer = vim_layer_no;
+
+  if (keycode == VIM_ESC && vim.cmdsize > 0) {
+    // cancel the half typed command, back to how things were before it started
+    vim = vim_snapshot;
+    return true;
+  }
 
   if (keycode == VIM_ESC) {
-    currmode = COMMAND_MODE;
-    layer_on(vim_layer);
-    visual_mode = false;
-    currcmdsize = 0;
+    vim.mode = COMMAND_MODE;
+    layer_on(vim.layer);
+    vim.visual = false;
+    vim.cmdsize = 0;
+    return true;
   }
 
-  if (currmode == INSERT_SAVE_MODE) {
-    if(currsavesize == SAVEBUFFSIZE || keycode < KC_A || keycode > KC_SLASH) {
-        currmode = INSERT_MODE;
-        savedcmdsize = 0;
-        currsavesize = 0;
+  if (vim.mode == INSERT_SAVE_MODE) {
+    if(vim.savesize == SAVEBUFFSIZE || keycode < KC_A || keycode > KC_SLASH) {
+        vim.mode = INSERT_MODE;
+        vim.savedcmdsize = 0;
+        vim.savesize = 0;
         return false;
     }
 
-    saved_keycodes[currsavesize] = keycode;
-    saved_shiftstate[currsavesize++] = SHIFT_HELD;
+    vim.saved_keycodes[vim.savesize] = keycode;
+    if (SHIFT_HELD)
+      vim.saved_shift |= 1 << vim.savesize;
+    else
+      vim.saved_shift &= ~(1 << vim.savesize);
+    vim.savesize++;
     return false;
-  } else if (currmode == INSERT_MODE) {
+  } else if (vim.mode == INSERT_MODE) {
     return false;
   }
 
@@ -898,56 +1400,514 @@ bool handle_vim_mode(uint16_t keycode, keyrecord_t *record, uint8_t vim_layer_no
   }
 
   if (CTRL_HELD) {
+    // put back exactly the ctrl keys that are physically down, not always left ctrl
+    uint8_t ctrl = get_mods() & MOD_MASK_CTRL;
+    uint16_t page = keycode == KC_D ? KC_PGDN : KC_PGUP;
     if (keycode == KC_R) {
-      HOLD_SHIFT;
-      UNHOLD_CTRL;
-      mod_os( KC_Z);
-      HOLD_CTRL;
-      UNHOLD_SHIFT;
+      mods_tx_begin();
+      unhold_mods(ctrl);
+      os_tap(OS_REDO);
+      hold_mods(ctrl);
+      mods_tx_end();
       return true;
-    } else if (keycode == KC_D) {
-      UNHOLD_CTRL;
-      tap_code(KC_PGDN);
-      HOLD_CTRL;
-      return true;
-    } else if (keycode == KC_U) {
-      UNHOLD_CTRL;
-      tap_code(KC_PGUP);
-      HOLD_CTRL;
+    } else if (keycode == KC_D || keycode == KC_U) {
+      mods_tx_begin();
+      unhold_mods(ctrl);
+      tap_key(page);
+      hold_mods(ctrl);
+      mods_tx_end();
       return true;
     }
     go_insert_mode();
     return false;
   }
 
+  // an ex command just collects characters until enter
+  if (is_ex_cmd() && keycode == KC_ENT) {
+    run_ex_cmd();
+    return true;
+  }
+
   char ch = keycode_to_char(keycode, record);
   if(ch == NO_CHAR)
     return true;
 
   add_to_vim_cmd(ch);
-  handle_vim_cmd();
+  if (!is_ex_cmd())
+    handle_vim_cmd();
   return true;
 }
 
 
 
-bool process_record_user(uint16_t keycode, keyrecord_t *record) {
+// Wheel scrolling. A tap still sends a single click, holding past SCROLL_DELAY
+// ramps the speed up to SCROLL_MAX_SPEED and letting go of a fast scroll keeps it going and eases
+// out instead of stopping dead. Speed and position are 8.8 fixed point wheel
+// clicks; housekeeping sends at most SCROLL_MAX_STEPS clicks per tick.
+typedef struct {
+  uint16_t fwd;   // keycode for a positive step
+  uint16_t back;  // and for a negative one
+  int8_t   held;  // -1, 0 or 1
+  uint16_t since; // when held was set
+  int16_t  vel;
+  int16_t  pos;
+} scroll_axis_t;
+
+scroll_axis_t scroll_axes[] = {
+  { KC_WH_U, KC_WH_D },
+  { KC_WH_R, KC_WH_L },
+};
+uint16_t scroll_timer;
+
+bool process_scroll(uint16_t keycode, keyrecord_t *record) {
+  for (uint8_t i = 0; i < sizeof(scroll_axes) / sizeof(scroll_axes[0]); i++) {
+    scroll_axis_t *a = &scroll_axes[i];
+    int8_t dir = keycode == a->fwd ? 1 : keycode == a->back ? -1 : 0;
+    if (dir == 0)
+      continue;
+    if (record->event.pressed) {
+      if (a->held != dir && a->vel * dir < 0) {
+        a->vel = 0;
+        a->pos = 0;
+      }
+      if (a->held == 0 && a->vel == 0)
+        tap_code(keycode);
+      a->held = dir;
+      a->since = timer_read();
+      scroll_timer = timer_read();
+    } else if (a->held == dir) {
+      a->held = 0;
+      if (a->vel * dir < SCROLL_MOMENTUM_MIN) {
+        a->vel = 0;
+        a->pos = 0;
+      }
+    }
+    return false;
+  }
+  return true;
+}
+
+void scroll_task(void) {
+  if (timer_elapsed(scroll_timer) < SCROLL_INTERVAL)
+    return;
+  scroll_timer = timer_read();
+
+  for (uint8_t i = 0; i < sizeof(scroll_axes) / sizeof(scroll_axes[0]); i++) {
+    scroll_axis_t *a = &scroll_axes[i];
+    // until SCROLL_DELAY is up a held key is still just the click it sent on the
+    // press, so a tap doesn't pick up a second one from the first tick
+    if (a->held && timer_elapsed(a->since) >= SCROLL_DELAY) {
+      a->vel += a->held * SCROLL_ACCEL;
+      if (a->vel > SCROLL_MAX_SPEED)
+        a->vel = SCROLL_MAX_SPEED;
+      else if (a->vel < -SCROLL_MAX_SPEED)
+        a->vel = -SCROLL_MAX_SPEED;
+    } else if (a->vel != 0) {
+      a->vel -= a->vel / (1 << SCROLL_FRICTION);
+      if (a->vel > -SCROLL_ACCEL && a->vel < SCROLL_ACCEL) {
+        a->vel = 0;
+        a->pos = 0;
+      }
+    }
+    if (a->vel == 0)
+      continue;
+
+    a->pos += a->vel;
+    uint16_t key   = a->pos > 0 ? a->fwd : a->back;
+    int16_t  steps = (a->pos > 0 ? a->pos : -a->pos) >> 8;
+    if (steps > SCROLL_MAX_STEPS)
+      steps = SCROLL_MAX_STEPS;
+    a->pos -= (a->pos > 0 ? steps : -steps) * 256;
+    tap_code_num(key, steps);
+  }
+}
+
+// Snippets: typing a trigger on the base layer replaces it with the expansion.
+// Triggers live in a trie in flash, one byte of state advanced once per key. A
+// node's children are chained through next, snippet is 1 + the index into
+// snippets[] for the node that ends a trigger, 0 is "none" for all three links
+// (the root is never anyone's child). The table is generated from snippets.txt by
+// tools/gen_snippets.py. Triggers start with ,, so they don't go off in normal
+// typing.
+typedef struct {
+  char    c;
+  uint8_t child;
+  uint8_t next;
+  uint8_t snippet;
+} snippet_node_t;
+
+#include "snippets.h"
+
+uint8_t     snippet_state = 0;
+uint8_t     snippet_depth = 0;
+uint8_t     snippet_erase = 0;
+const char *snippet_out   = NULL;
+uint16_t    snippet_timer;
+
+char snippet_char(uint16_t keycode) {
+  if (get_mods())
+    return NO_CHAR;
+  if (keycode >= KC_A && keycode <= KC_Z)
+    return 'a' + (keycode - KC_A);
+  if (keycode == KC_COMM)
+    return ',';
+  return NO_CHAR;
+}
+
+void snippet_feed(uint16_t keycode) {
+  char c = snippet_char(keycode);
+  for (;;) {
+    for (uint8_t n = pgm_read_byte(&snippet_trie[snippet_state].child); n != 0; n = pgm_read_byte(&snippet_trie[n].next)) {
+      if (pgm_read_byte(&snippet_trie[n].c) != c)
+        continue;
+      uint8_t snippet = pgm_read_byte(&snippet_trie[n].snippet);
+      snippet_depth++;
+      snippet_state = n;
+      if (snippet != 0 && snippet_out == NULL) {
+        snippet_erase = snippet_depth;
+        snippet_out   = snippets[snippet - 1];
+        snippet_state = 0;
+        snippet_depth = 0;
+      }
+      return;
+    }
+    // no match, a trigger could still be starting with this key
+    if (snippet_state == 0)
+      return;
+    snippet_state = 0;
+    snippet_depth = 0;
+  }
+}
+
+// sends the trigger's backspaces and then the expansion, one key per
+// SNIPPET_INTERVAL so the host doesn't drop any and the scan loop never blocks
+void snippet_task(void) {
+  if (snippet_out == NULL || timer_elapsed(snippet_timer) < SNIPPET_INTERVAL)
+    return;
+  snippet_timer = timer_read();
+  if (snippet_erase != 0) {
+    snippet_erase--;
+    tap_code(KC_BSPC);
+    return;
+  }
+  char c = pgm_read_byte(snippet_out++);
+  if (c == NO_CHAR)
+    snippet_out = NULL;
+  else
+    send_char(c);
+}
+
+// Staged startup: the board is usable as soon as the matrix and USB are up, the
+// startup song and turning the RGB on wait STARTUP_DEFER ms so they're not in the
+// way of the first reports after power on or a KVM switch. The time until the host
+// has configured USB (the driver goes active) goes to the console, since power on
+// (the timer starts at 0 there) and since the wake after every resume. The first key
+// event after each is printed as well, that's more about when someone typed.
+bool     startup_pending = true;
+bool     startup_rgb;
+uint32_t startup_timer;
+bool     usb_active_pending = true;
+bool     first_key_pending = true;
+bool     resumed = false;
+uint32_t resume_timer;
+
+void startup_task(void) {
+  if (!startup_pending || timer_elapsed32(startup_timer) < STARTUP_DEFER)
+    return;
+  startup_pending = false;
+  if (startup_rgb) {
+    // layer changes before now couldn't set their colour with the RGB off
+    rgblight_enable_noeeprom();
+    set_layer_colour(vim.last_layer_on);
+  }
+#ifdef AUDIO_ENABLE
+  PLAY_SONG(startup_song_late);
+#endif
+}
+
+void usb_active_stamp(void) {
+  if (!usb_active_pending || USB_DRIVER.state != USB_ACTIVE)
+    return;
+  usb_active_pending = false;
+#ifdef CONSOLE_ENABLE
+  if (resumed)
+    uprintf("usb active %lums after resume\n", timer_elapsed32(resume_timer));
+  else
+    uprintf("usb active %lums after boot\n", timer_read32());
+#endif
+}
+
+void first_key_stamp(void) {
+  if (!first_key_pending)
+    return;
+  first_key_pending = false;
+#ifdef CONSOLE_ENABLE
+  if (resumed)
+    uprintf("  first key %lums after resume\n", timer_elapsed32(resume_timer));
+  else
+    uprintf("  first key %lums after boot\n", timer_read32());
+#endif
+}
+
+void suspend_wakeup_init_user(void) {
+  resumed      = true;
+  resume_timer = timer_read32();
+  usb_active_pending = true;
+  first_key_pending  = true;
+}
+
+#ifdef CYCLE_PROFILE_ENABLE
+// Cycle counts per path through process_record_user, read off the Cortex-M4 DWT
+// counter on the board itself. Keys that get through to core (layer keys, plain keys)
+// are timed up to post_process_record_user so that work is counted too. Combos are
+// resolved before process_record_user sees anything, so only the combo's output key
+// is timed, not the combo matching. Admin layer F10 prints the table to the console
+// and clears it, ctrl+F10 replays profile_script and prints the table for just that.
+// make -C tools emu runs the same script in an emulator off the board (readme.md).
+enum profile_path {
+  PATH_DIRECT,
+  PATH_VIM,
+  PATH_ADMIN,
+  PATH_LAYER,
+  PATH_PASS,
+  PATH_COUNT
+};
 
-  bool vim_handled = handle_vim_mode(keycode, record, last_layer_on);
+const char *const profile_path_names[PATH_COUNT] = {
+  [PATH_DIRECT] = "direct",
+  [PATH_VIM]    = "vim",
+  [PATH_ADMIN]  = "admin",
+  [PATH_LAYER]  = "layer",
+  [PATH_PASS]   = "pass",
+};
+
+typedef struct {
+  uint32_t count;
+  uint32_t total;
+  uint32_t max;
+} path_cycles_t;
+
+path_cycles_t path_cycles[PATH_COUNT];
+uint8_t       profile_path;
+uint32_t      profile_start;
+bool          profile_running;
+
+#define PROFILE_PATH(p) profile_path = (p)
+
+void cycle_profile_init(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void cycle_profile_stop(void) {
+  if (!profile_running)
+    return;
+  profile_running = false;
+  uint32_t cycles = DWT->CYCCNT - profile_start;
+  path_cycles_t *p = &path_cycles[profile_path];
+  p->count++;
+  p->total += cycles;
+  if (cycles > p->max)
+    p->max = cycles;
+}
+
+void cycle_profile_dump(void) {
+  uprintf("path      events      avg      max\n");
+  for (uint8_t i = 0; i < PATH_COUNT; i++) {
+    path_cycles_t *p = &path_cycles[i];
+    uprintf("%-6s  %8lu %8lu %8lu\n", profile_path_names[i], p->count, p->count ? p->total / p->count : 0, p->max);
+  }
+  memset(path_cycles, 0, sizeof(path_cycles));
+}
+
+void post_process_record_user(uint16_t keycode, keyrecord_t *record) {
+  cycle_profile_stop();
+}
+
+// the events ctrl+F10 replays, shared with tools/path_bench
+#include "profile_script.h"
+
+#define PROFILE_SCRIPT_IDLE 0xFF
+
+uint8_t  profile_script_pos = PROFILE_SCRIPT_IDLE;
+uint8_t  profile_script_phase;
+keypos_t profile_script_keys[2];
+
+bool profile_script_find(uint16_t keycode, keypos_t *key) {
+  uint8_t layer = get_highest_layer(layer_state);
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+      if (pgm_read_word(&keymaps[layer][row][col]) == keycode) {
+        key->row = row;
+        key->col = col;
+        return true;
+      }
+    }
+  }
+  uprintf("profile script: %04x isn't on layer %u\n", keycode, layer);
+  return false;
+}
+
+void profile_script_start(void) {
+  memset(path_cycles, 0, sizeof(path_cycles));
+  profile_script_pos   = 0;
+  profile_script_phase = 0;
+}
+
+// One key event per scan: the downs in order, then the ups. Waits for the ctrl from
+// ctrl+F10 to be let go before the first one.
+void profile_script_task(void) {
+  if (profile_script_pos == PROFILE_SCRIPT_IDLE)
+    return;
+  if (profile_script_pos == PROFILE_SCRIPT_LEN) {
+    profile_script_pos = PROFILE_SCRIPT_IDLE;
+    cycle_profile_dump();
+    return;
+  }
+  if (profile_script_pos == 0 && profile_script_phase == 0 && get_mods())
+    return;
+
+  uint16_t second  = pgm_read_word(&profile_script[profile_script_pos].second);
+  uint8_t  keys    = second == KC_NO ? 1 : 2;
+  uint8_t  i       = profile_script_phase % keys;
+  bool     pressed = profile_script_phase < keys;
+  keypos_t *key    = &profile_script_keys[i];
+
+  if (pressed && !profile_script_find(i ? second : pgm_read_word(&profile_script[profile_script_pos].first), key)) {
+    profile_script_pos = PROFILE_SCRIPT_IDLE;
+    return;
+  }
+  action_exec(MAKE_KEYEVENT(key->row, key->col, pressed));
+  if (++profile_script_phase == 2 * keys) {
+    profile_script_phase = 0;
+    profile_script_pos++;
+  }
+}
+#else
+#define PROFILE_PATH(p)
+#endif
+
+void matrix_scan_user(void) {
+  usb_active_stamp();
+  startup_task();
+  tap_queue_task();
+#ifdef CYCLE_PROFILE_ENABLE
+  profile_script_task();
+#endif
+  if (gaming_mode)
+    return;
+  held_motion_task();
+  scroll_task();
+  snippet_task();
+}
+
+// Basic keys whose press went through to core. The release has to follow it there
+// whatever mode or layer the vim layer has moved to since, or the host sees the
+// key held forever (j down in insert mode, TT(3), j up).
+uint8_t core_keys_down[32];
+
+bool core_key_track(uint16_t keycode, keyrecord_t *record, bool to_core) {
+  if (to_core && keycode <= 0xFF) {
+    if (record->event.pressed)
+      core_keys_down[keycode / 8] |= 1 << (keycode % 8);
+    else
+      core_keys_down[keycode / 8] &= ~(1 << (keycode % 8));
+  }
+  return to_core;
+}
+
+bool core_key_release(uint16_t keycode, keyrecord_t *record) {
+  if (record->event.pressed || keycode > 0xFF || !(core_keys_down[keycode / 8] & (1 << (keycode % 8))))
+    return false;
+  core_keys_down[keycode / 8] &= ~(1 << (keycode % 8));
+  return true;
+}
+
+bool process_record_keymap(uint16_t keycode, keyrecord_t *record) {
+  // every release goes to core on these layers anyway, core_key_track drops its bit
+  PROFILE_PATH(PATH_DIRECT);
+  if (gaming_mode || steno_active)
+    return true;
+
+  PROFILE_PATH(PATH_PASS);
+  if (core_key_release(keycode, record))
+    return true;
+
+  PROFILE_PATH(PATH_VIM);
+  tap_queue_begin();
+  bool vim_handled = handle_vim_mode(keycode, record, vim.last_layer_on);
+  if (!tap_queue_end()) {
+#ifdef CONSOLE_ENABLE
+    uprintf("tap queue full, dropped %04x\n", keycode);
+#endif
+  }
   if (vim_handled){
         return false;
   }
-  if (last_layer_on == 7 && keycode == KC_MS_U) {
-	  ismac = true;
+  PROFILE_PATH(PATH_ADMIN);
+  if (vim.last_layer_on == 7 && keycode == KC_MS_U) {
+	  os_profile = os_profiles[OS_MAC];
 	  layer_move(0);
 	  return false;
   }
-  if (last_layer_on == 7 && keycode == KC_MS_D) {
-	  ismac = false;
+  if (vim.last_layer_on == 7 && keycode == KC_MS_D) {
+	  os_profile = os_profiles[OS_WIN];
 	  layer_move(0);
 	  return false;
   }
-    return true;
+  if (vim.last_layer_on == 7 && keycode == KC_MS_L) {
+	  os_profile = os_profiles[OS_LINUX];
+	  layer_move(0);
+	  return false;
+  }
+#ifdef CYCLE_PROFILE_ENABLE
+  if (vim.last_layer_on == 7 && keycode == KC_F10) {
+	  if (record->event.pressed && CTRL_HELD)
+		  profile_script_start();
+	  else if (record->event.pressed)
+		  cycle_profile_dump();
+	  return false;
+  }
+#endif
+  PROFILE_PATH(keycode >= QK_TO && keycode <= QK_LAYER_TAP_TOGGLE_MAX ? PATH_LAYER : PATH_PASS);
+  if (!process_scroll(keycode, record))
+    return false;
+  if (vim.last_layer_on == 0 && record->event.pressed)
+    snippet_feed(keycode);
+  return true;
+}
 
+void keyboard_post_init_user(void) {
+  startup_timer = timer_read32();
+  startup_rgb = rgblight_is_enabled();
+  rgblight_disable_noeeprom();
+#ifdef STENO_ENABLE
+  steno_set_mode(STENO_MODE_GEMINI);
+#endif
+#ifdef CYCLE_PROFILE_ENABLE
+  cycle_profile_init();
+#endif
+}
+
+bool process_record_user(uint16_t keycode, keyrecord_t *record) {
+  first_key_stamp();
+#ifdef CYCLE_PROFILE_ENABLE
+  profile_start   = DWT->CYCCNT;
+  profile_running = true;
+  if (!core_key_track(keycode, record, process_record_keymap(keycode, record))) {
+    cycle_profile_stop();
+    return false;
   }
+#ifdef STENO_ENABLE
+  // process_steno runs after this and always returns false, so there's no
+  // post_process_record_user to stop the timer for steno keys
+  if (keycode >= QK_STENO && keycode <= QK_STENO_MAX)
+    cycle_profile_stop();
+#endif
+  return true;
+#else
+  return core_key_track(keycode, record, process_record_keymap(keycode, record));
+#endif
+}
 
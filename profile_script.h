@@ -0,0 +1,30 @@
+// The key events the cycle profiler replays (admin layer ctrl+F10, see keymap.c) and
+// tools/path_bench replays on the pc and in an emulator. The same events every run so
+// two builds can be compared: typing, combos, layer keys, vim commands and the CS
+// layer, ending on the admin combo. A step with two keys holds both and then lets
+// both go. Each key is looked up by keycode on the top layer at the time.
+// It really types, so have a scratch buffer focused.
+#pragma once
+
+typedef struct {
+  uint16_t first;
+  uint16_t second;
+} profile_step_t;
+
+const profile_step_t PROGMEM profile_script[] = {
+  {TO(0)},
+  {KC_H}, {KC_E}, {KC_L}, {KC_L}, {KC_O}, {KC_SPC},
+  {KC_Q, KC_W}, {KC_C, KC_V}, {KC_L, KC_QUOT},
+  {MO(2), KC_LEFT}, {MO(2), KC_RGHT},
+  {TT(1)}, {KC_1}, {KC_2}, {TO(0)},
+  {TT(3)},
+  {KC_B}, {KC_W}, {VIM_NUM, KC_3}, {KC_J}, {KC_G}, {KC_G},
+  {KC_D}, {KC_W}, {KC_U}, {KC_Y}, {KC_Y}, {KC_X}, {KC_U}, {KC_D}, {VIM_ESC},
+  {TO(0)},
+  {KC_TAB, KC_BSPC},
+  {KC_W}, {KC_A}, {KC_S}, {KC_D}, {KC_LSFT, KC_W}, {KC_SPC}, {KC_1}, {KC_R},
+  {TO(0)},
+  {KC_LCTL, KC_SLSH},
+};
+
+#define PROFILE_SCRIPT_LEN (sizeof(profile_script) / sizeof(profile_script[0]))
@@ -1,2 +1,3 @@
-SRC += muse.c
 COMBO_ENABLE = yes
+STENO_ENABLE = yes
+RAW_ENABLE = yes
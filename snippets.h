@@ -0,0 +1,35 @@
+// Generated by tools/gen_snippets.py from snippets.txt, don't edit.
+//  ,,inc  ,,main  ,,todo  ,,gpl
+#pragma once
+
+const snippet_node_t PROGMEM snippet_trie[] = {
+  [ 0] = { 0,    1,  0, 0 },
+  [ 1] = { ',',  2,  0, 0 },
+  [ 2] = { ',',  3,  0, 0 },
+  [ 3] = { 'g',  7,  4, 0 },
+  [ 4] = { 'i',  8,  5, 0 },
+  [ 5] = { 'm',  9,  6, 0 },
+  [ 6] = { 't', 10,  0, 0 },
+  [ 7] = { 'p', 11,  0, 0 },
+  [ 8] = { 'n', 12,  0, 0 },
+  [ 9] = { 'a', 13,  0, 0 },
+  [10] = { 'o', 14,  0, 0 },
+  [11] = { 'l',  0,  0, 4 },
+  [12] = { 'c',  0,  0, 1 },
+  [13] = { 'i', 15,  0, 0 },
+  [14] = { 'd', 16,  0, 0 },
+  [15] = { 'n',  0,  0, 2 },
+  [16] = { 'o',  0,  0, 3 },
+};
+
+const char snippet_0[] PROGMEM = "#include ";  // ,,inc
+const char snippet_1[] PROGMEM = "int main(int argc, char *argv[]) {\n";  // ,,main
+const char snippet_2[] PROGMEM = "// TODO: ";  // ,,todo
+const char snippet_3[] PROGMEM = "// SPDX-License-Identifier: GPL-2.0-or-later\n";  // ,,gpl
+
+const char *const snippets[] = {
+  snippet_0,
+  snippet_1,
+  snippet_2,
+  snippet_3,
+};
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""Generate snippets.h (the snippet trie and expansions) from snippets.txt.
+
+keymap.c includes the generated header, QMK's build doesn't run this so the
+header is checked in. Run it after editing snippets.txt:
+
+    python3 tools/gen_snippets.py            # rewrite snippets.h
+    python3 tools/gen_snippets.py --check    # exit 1 if snippets.h is out of date
+
+Nodes are numbered breadth first so every node's children are next to each
+other, node 0 is the root. See the Snippets comment in keymap.c for the layout.
+"""
+import argparse
+import ast
+import os
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(HERE)
+PREFIX = ",,"
+TRIGGER_CHARS = set("abcdefghijklmnopqrstuvwxyz,")
+MAX_NODES = 255  # child/next/snippet are uint8_t and 0 means none
+
+
+def fail(path, line_no, msg):
+    sys.exit("%s:%d: %s" % (path, line_no, msg))
+
+
+def read_snippets(path):
+    snippets = []
+    with open(path) as f:
+        for line_no, line in enumerate(f, 1):
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            m = re.match(r'(\S+)\s+(".*")$', line)
+            if not m:
+                fail(path, line_no, 'expected <trigger> "<expansion>"')
+            trigger, literal = m.groups()
+            if not trigger.startswith(PREFIX) or len(trigger) == len(PREFIX):
+                fail(path, line_no, "trigger %r must start with %r" % (trigger, PREFIX))
+            if not set(trigger) <= TRIGGER_CHARS:
+                fail(path, line_no, "trigger %r can only use a-z and ," % trigger)
+            try:
+                expansion = ast.literal_eval(literal)
+            except (ValueError, SyntaxError):
+                fail(path, line_no, "bad string %s" % literal)
+            if not expansion or any(ord(c) > 127 for c in expansion):
+                fail(path, line_no, "expansion must be non-empty ascii")
+            snippets.append((line_no, trigger, literal, expansion))
+    if not snippets:
+        sys.exit("%s: no snippets" % path)
+    if len(snippets) > 255:
+        sys.exit("%s: at most 255 snippets" % path)
+    for line_no, trigger, _, _ in snippets:
+        for _, other, _, _ in snippets:
+            if other != trigger and other.startswith(trigger):
+                fail(path, line_no, "trigger %r is the start of %r" % (trigger, other))
+    seen = set()
+    for line_no, trigger, _, _ in snippets:
+        if trigger in seen:
+            fail(path, line_no, "trigger %r twice" % trigger)
+        seen.add(trigger)
+    return snippets
+
+
+def build_trie(snippets):
+    # nested dicts first, then number them breadth first
+    tree = {}
+    for index, (_, trigger, _, _) in enumerate(snippets):
+        node = tree
+        for c in trigger:
+            node = node.setdefault(c, {})
+        node[None] = index + 1
+
+    nodes = [[0, 0, 0, 0]]  # c, child, next, snippet
+    queue = [(0, tree)]
+    while queue:
+        parent, children = queue.pop(0)
+        prev = None
+        for c in sorted(k for k in children if k is not None):
+            i = len(nodes)
+            nodes.append([c, 0, 0, children[c].get(None, 0)])
+            if prev is None:
+                nodes[parent][1] = i
+            else:
+                nodes[prev][2] = i
+            prev = i
+            queue.append((i, children[c]))
+    if len(nodes) > MAX_NODES:
+        sys.exit("%d trie nodes, at most %d fit" % (len(nodes), MAX_NODES))
+    return nodes
+
+
+def c_char(c):
+    return "0" if c == 0 else "'%s'" % c.replace("\\", "\\\\").replace("'", "\\'")
+
+
+def render(snippets, nodes):
+    width = len(str(len(nodes) - 1))
+    out = [
+        "// Generated by tools/gen_snippets.py from snippets.txt, don't edit.",
+        "//  " + "  ".join(trigger for _, trigger, _, _ in snippets),
+        "#pragma once",
+        "",
+        "const snippet_node_t PROGMEM snippet_trie[] = {",
+    ]
+    for i, (c, child, nxt, snippet) in enumerate(nodes):
+        out.append("  [%*d] = { %-4s %*d, %*d, %d }," % (
+            width, i, c_char(c) + ",", width, child, width, nxt, snippet))
+    out.append("};")
+    out.append("")
+    names = []
+    for index, (_, trigger, literal, _) in enumerate(snippets):
+        name = "snippet_%d" % index
+        names.append(name)
+        out.append("const char %s[] PROGMEM = %s;  // %s" % (name, literal, trigger))
+    out.append("")
+    out.append("const char *const snippets[] = {")
+    for name in names:
+        out.append("  %s," % name)
+    out.append("};")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--input", default=os.path.join(ROOT, "snippets.txt"))
+    ap.add_argument("--output", default=os.path.join(ROOT, "snippets.h"))
+    ap.add_argument("--check", action="store_true", help="don't write, exit 1 if the output is stale")
+    args = ap.parse_args()
+
+    snippets = read_snippets(args.input)
+    text = render(snippets, build_trie(snippets))
+    if args.check:
+        try:
+            with open(args.output) as f:
+                current = f.read()
+        except FileNotFoundError:
+            current = None
+        if current != text:
+            sys.exit("%s is out of date, run tools/gen_snippets.py" % args.output)
+        return
+    with open(args.output, "w") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    main()
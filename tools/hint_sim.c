@@ -0,0 +1,25 @@
+/* The keymap's raw HID handler on the host, for vim_hint_agent.py --sim.
+ *
+ * Reads 32 byte packets on stdin, hands each to raw_hid_receive() and writes
+ * back the 32 byte reply, all zeros if the keymap didn't send one. Starts on
+ * the vim layer in command mode, like the board after TT(3).
+ */
+#include <stdio.h>
+
+#include "keymap.c"
+
+int main(void) {
+  uint8_t packet[32];
+
+  stub_reset();
+  keyboard_post_init_user();
+  stub_tap(TT(3));
+  while (fread(packet, sizeof(packet), 1, stdin) == 1) {
+    memset(stub_raw_reply, 0, sizeof(stub_raw_reply));
+    raw_hid_receive(packet, sizeof(packet));
+    if (fwrite(stub_raw_reply, sizeof(stub_raw_reply), 1, stdout) != 1)
+      return 1;
+    fflush(stdout);
+  }
+  return 0;
+}
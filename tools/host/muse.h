@@ -0,0 +1,4 @@
+#pragma once
+
+// keymap.c included this before the muse code was dropped, report_bench builds
+// those versions too. nothing in it was used.
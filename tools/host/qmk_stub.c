@@ -0,0 +1,430 @@
+/* Host side of qmk_stub.h: the bits of QMK core keymap.c talks to, modelled
+ * closely enough to count reports and track what the host would see, plus a
+ * minimal core (basic keys, mods, TO/MO/TG/TT) for keys the keymap passes on.
+ */
+#include "qmk_stub.h"
+#include "raw_hid.h"
+#include "usb_main.h"
+
+/* everything below is board state, except the counters which the tools read and
+ * reset themselves; they live in their own section so a snapshot of the keymap
+ * and stub state (see vim_explore.c) doesn't include them */
+__attribute__((section("stub_stats"))) stub_counters_t stub_counters;
+
+layer_state_t layer_state;
+uint8_t       stub_keys_down[32];
+uint8_t       stub_sent_mods;
+uint32_t      stub_now;
+uint8_t       stub_raw_reply[32];
+uint8_t       stub_rgb[3];
+uint8_t       stub_phys_mods;
+uint8_t       stub_phys_keys[32];
+bool          stub_combos;
+USBDriver     USBD1;
+#ifndef __arm__
+DWT_Type       stub_dwt;
+CoreDebug_Type stub_core_debug;
+#endif
+
+static uint8_t       mods;
+static uint8_t       rgb_mode;
+static bool          rgb_enabled;
+static bool          combos_enabled;
+static layer_state_t tt_was_on;
+static uint16_t      tt_timer[32];
+static uint16_t      combo_held;       // a combo key held back to see what comes next
+static keyevent_t    combo_held_event;
+static int8_t        combo_fired = -1; // the combo whose keys are down
+static uint8_t       combo_ups;
+
+void stub_reset(void) {
+  layer_state    = 0;
+  mods           = 0;
+  stub_sent_mods = 0;
+  stub_now       = 1000;
+  rgb_mode       = RGBLIGHT_MODE_STATIC_LIGHT;
+  rgb_enabled    = true;
+  combos_enabled = true;
+  tt_was_on      = 0;
+  stub_combos    = false;
+  combo_held     = 0;
+  combo_fired    = -1;
+  stub_phys_mods = 0;
+  USBD1.state    = USB_ACTIVE;
+  memset(stub_keys_down, 0, sizeof(stub_keys_down));
+  memset(stub_phys_keys, 0, sizeof(stub_phys_keys));
+  memset(stub_raw_reply, 0, sizeof(stub_raw_reply));
+  memset(stub_rgb, 0, sizeof(stub_rgb));
+  memset(&stub_counters, 0, sizeof(stub_counters));
+}
+
+static bool is_mod(uint8_t code) {
+  return code >= KC_LCTRL && code <= KC_RGUI;
+}
+
+uint8_t get_mods(void) {
+  return mods;
+}
+
+void add_mods(uint8_t m) {
+  mods |= m;
+}
+
+void del_mods(uint8_t m) {
+  mods &= ~m;
+}
+
+void set_mods(uint8_t m) {
+  mods = m;
+}
+
+void send_keyboard_report(void) {
+  stub_counters.reports++;
+  stub_sent_mods = mods;
+}
+
+void register_mods(uint8_t m) {
+  if (m) {
+    add_mods(m);
+    send_keyboard_report();
+  }
+}
+
+void unregister_mods(uint8_t m) {
+  if (m) {
+    del_mods(m);
+    send_keyboard_report();
+  }
+}
+
+void register_code(uint8_t code) {
+  if (code == KC_NO)
+    return;
+  if (is_mod(code))
+    add_mods(MOD_BIT(code));
+  else
+    stub_keys_down[code / 8] |= 1 << (code % 8);
+  send_keyboard_report();
+}
+
+void unregister_code(uint8_t code) {
+  if (code == KC_NO)
+    return;
+  if (is_mod(code))
+    del_mods(MOD_BIT(code));
+  else
+    stub_keys_down[code / 8] &= ~(1 << (code % 8));
+  send_keyboard_report();
+}
+
+void tap_code(uint8_t code) {
+  stub_counters.taps++;
+  register_code(code);
+  unregister_code(code);
+}
+
+void clear_keyboard(void) {
+  mods = 0;
+  memset(stub_keys_down, 0, sizeof(stub_keys_down));
+  send_keyboard_report();
+}
+
+/* send_string taps the key with shift around it if needed, on its own reports */
+void send_char(char ascii_code) {
+  (void)ascii_code;
+  stub_counters.sent_chars++;
+  stub_counters.reports += 2;
+}
+
+bool stub_key_down(uint8_t code) {
+  return stub_keys_down[code / 8] & (1 << (code % 8));
+}
+
+bool stub_any_key_down(void) {
+  for (size_t i = 0; i < sizeof(stub_keys_down); i++)
+    if (stub_keys_down[i])
+      return true;
+  return false;
+}
+
+static void layer_state_set(layer_state_t state) {
+  layer_state = layer_state_set_user(state);
+}
+
+void layer_move(uint8_t layer) {
+  layer_state_set((layer_state_t)1 << layer);
+}
+
+void layer_on(uint8_t layer) {
+  layer_state_set(layer_state | (layer_state_t)1 << layer);
+}
+
+void layer_off(uint8_t layer) {
+  layer_state_set(layer_state & ~((layer_state_t)1 << layer));
+}
+
+void layer_invert(uint8_t layer) {
+  layer_state_set(layer_state ^ (layer_state_t)1 << layer);
+}
+
+bool layer_state_cmp(layer_state_t state, uint8_t layer) {
+  if (!state)
+    return layer == 0;
+  return (state & ((layer_state_t)1 << layer)) != 0;
+}
+
+bool layer_state_is(uint8_t layer) {
+  return layer_state_cmp(layer_state, layer);
+}
+
+uint8_t get_highest_layer(layer_state_t state) {
+  for (uint8_t layer = 31; layer > 0; layer--)
+    if (state & ((layer_state_t)1 << layer))
+      return layer;
+  return 0;
+}
+
+void rgblight_setrgb(uint8_t r, uint8_t g, uint8_t b) {
+  stub_counters.rgb_sets++;
+  stub_rgb[0] = r;
+  stub_rgb[1] = g;
+  stub_rgb[2] = b;
+}
+
+uint8_t rgblight_get_mode(void) {
+  return rgb_mode;
+}
+
+void rgblight_mode_noeeprom(uint8_t mode) {
+  rgb_mode = mode;
+}
+
+bool rgblight_is_enabled(void) {
+  return rgb_enabled;
+}
+
+void rgblight_enable_noeeprom(void) {
+  rgb_enabled = true;
+}
+
+void rgblight_disable_noeeprom(void) {
+  rgb_enabled = false;
+}
+
+void combo_enable(void) {
+  combos_enabled = true;
+}
+
+/* core forgets a combo that's down, its keys come up as themselves */
+void combo_disable(void) {
+  combos_enabled = false;
+  combo_fired    = -1;
+}
+
+uint16_t timer_read(void) {
+  return (uint16_t)stub_now;
+}
+
+uint16_t timer_elapsed(uint16_t last) {
+  return (uint16_t)(stub_now - last);
+}
+
+uint32_t timer_read32(void) {
+  return stub_now;
+}
+
+uint32_t timer_elapsed32(uint32_t last) {
+  return stub_now - last;
+}
+
+void raw_hid_send(uint8_t *data, uint8_t length) {
+  memcpy(stub_raw_reply, data, length < sizeof(stub_raw_reply) ? length : sizeof(stub_raw_reply));
+}
+
+/* the keycode at a matrix position going down through the active layers */
+uint16_t stub_keycode_at(uint8_t row, uint8_t col) {
+  for (int8_t layer = 31; layer > 0; layer--) {
+    if (!(layer_state & ((layer_state_t)1 << layer)))
+      continue;
+    uint16_t keycode = pgm_read_word(&keymaps[layer][row][col]);
+    if (keycode != KC_TRNS)
+      return keycode;
+  }
+  return pgm_read_word(&keymaps[0][row][col]);
+}
+
+bool stub_find_key(uint16_t keycode, keypos_t *pos) {
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+      if (stub_keycode_at(row, col) == keycode) {
+        pos->row = row;
+        pos->col = col;
+        return true;
+      }
+    }
+  }
+  pos->row = pos->col = 0xFF;
+  return false;
+}
+
+/* what core does with a key process_record_user let through */
+static void core_action(uint16_t keycode, bool pressed) {
+  if (keycode <= 0xFF) {
+    if (pressed)
+      register_code(keycode);
+    else
+      unregister_code(keycode);
+  } else if (keycode >= QK_MODS && keycode <= QK_MODS_MAX) {
+    // register_code16 sends these mods as weak mods, the real ones are left alone
+    if (pressed)
+      register_code(keycode & 0xFF);
+    else
+      unregister_code(keycode & 0xFF);
+  } else if ((keycode & 0xFF00) == QK_TO) {
+    if (pressed)
+      layer_move(keycode & 0x0F);
+  } else if ((keycode & 0xFF00) == QK_MOMENTARY) {
+    if (pressed)
+      layer_on(keycode & 0xFF);
+    else
+      layer_off(keycode & 0xFF);
+  } else if ((keycode & 0xFF00) == QK_TOGGLE_LAYER) {
+    if (pressed)
+      layer_invert(keycode & 0xFF);
+  } else if ((keycode & 0xFF00) == QK_LAYER_TAP_TOGGLE) {
+    // held it's MO, tapped (TAPPING_TOGGLE is 1) it toggles
+    uint8_t       layer = keycode & 0x1F;
+    layer_state_t bit   = (layer_state_t)1 << layer;
+    if (pressed) {
+      tt_was_on = (tt_was_on & ~bit) | (layer_state & bit);
+      tt_timer[layer] = timer_read();
+      layer_on(layer);
+    } else if (timer_elapsed(tt_timer[layer]) >= TAPPING_TERM || (tt_was_on & bit)) {
+      layer_off(layer);
+    }
+  }
+}
+
+static void process(uint16_t keycode, keyevent_t event) {
+  keyrecord_t record = {.event = event};
+
+  if (keycode >= KC_LCTRL && keycode <= KC_RGUI) {
+    if (event.pressed)
+      stub_phys_mods |= MOD_BIT(keycode);
+    else
+      stub_phys_mods &= ~MOD_BIT(keycode);
+  }
+  if (!process_record_user(keycode, &record)) {
+    if (!event.pressed && keycode <= 0xFF)
+      stub_phys_keys[keycode / 8] &= ~(1 << (keycode % 8));
+    return;
+  }
+  if (keycode <= 0xFF && !(keycode >= KC_LCTRL && keycode <= KC_RGUI)) {
+    if (event.pressed)
+      stub_phys_keys[keycode / 8] |= 1 << (keycode % 8);
+    else
+      stub_phys_keys[keycode / 8] &= ~(1 << (keycode % 8));
+  }
+  core_action(keycode, event.pressed);
+  post_process_record_user(keycode, &record);
+}
+
+/* Combos, only with stub_combos set so the other tools can keep typing combo
+ * outputs straight in. Every combo in the keymap is two keys: a press of a combo
+ * key is held back, if the other key of a combo goes down next the combo's
+ * keycode goes down instead of both, and it goes up when the first of them does.
+ * Anything else, or COMBO_TERM passing, lets the held back press through. */
+static bool combo_has(int8_t combo, uint16_t keycode) {
+  return pgm_read_word(&key_combos[combo].keys[0]) == keycode || pgm_read_word(&key_combos[combo].keys[1]) == keycode;
+}
+
+/* the combo made of both keys, or with b KC_NO the first one a is in */
+static int8_t combo_of(uint16_t a, uint16_t b) {
+  for (int8_t i = 0; i < COMBO_COUNT; i++)
+    if (combo_has(i, a) && (b == KC_NO || (b != a && combo_has(i, b))))
+      return i;
+  return -1;
+}
+
+static void combo_release_held(void) {
+  if (combo_held != KC_NO) {
+    uint16_t keycode = combo_held;
+    combo_held = KC_NO;
+    process(keycode, combo_held_event);
+  }
+}
+
+static void dispatch(uint16_t keycode, keyevent_t event) {
+  if (!stub_combos || !combos_enabled) {
+    combo_release_held();
+    process(keycode, event);
+    return;
+  }
+  if (combo_fired >= 0 && !event.pressed && combo_has(combo_fired, keycode)) {
+    if (combo_ups++ == 0)
+      process(key_combos[combo_fired].keycode, event);
+    if (combo_ups == 2)
+      combo_fired = -1;
+    return;
+  }
+  if (event.pressed && combo_held != KC_NO) {
+    int8_t combo = combo_of(combo_held, keycode);
+    if (combo >= 0) {
+      combo_held  = KC_NO;
+      combo_fired = combo;
+      combo_ups   = 0;
+      process(key_combos[combo].keycode, event);
+      return;
+    }
+  }
+  combo_release_held();
+  if (event.pressed && combo_fired < 0 && combo_of(keycode, KC_NO) >= 0) {
+    combo_held       = keycode;
+    combo_held_event = event;
+    return;
+  }
+  process(keycode, event);
+}
+
+/* like core, a release is the keycode the press was, whatever the layers are now */
+void action_exec(keyevent_t event) {
+  static uint16_t pressed_as[MATRIX_ROWS][MATRIX_COLS];
+  uint16_t       *keycode = &pressed_as[event.key.row][event.key.col];
+  if (event.pressed)
+    *keycode = stub_keycode_at(event.key.row, event.key.col);
+  dispatch(*keycode, event);
+}
+
+/* a key event for a keycode rather than a position, for combo outputs and the
+ * like the position is 0xFF/0xFF */
+void stub_event(uint16_t keycode, bool pressed) {
+  keyevent_t event = {.pressed = pressed, .time = timer_read() | 1};
+  stub_find_key(keycode, &event.key);
+  dispatch(keycode, event);
+}
+
+void stub_tap(uint16_t keycode) {
+  stub_event(keycode, true);
+  stub_event(keycode, false);
+}
+
+/* QMK has empty weak defaults for the user hooks, older keymaps don't define them all */
+__attribute__((weak)) void matrix_scan_user(void) {}
+__attribute__((weak)) void keyboard_post_init_user(void) {}
+__attribute__((weak)) void post_process_record_user(uint16_t keycode, keyrecord_t *record) {
+  (void)keycode;
+  (void)record;
+}
+__attribute__((weak)) void raw_hid_receive(uint8_t *data, uint8_t length) {
+  (void)data;
+  (void)length;
+}
+
+void stub_scan(uint32_t ms) {
+  while (ms--) {
+    stub_now++;
+    if (combo_held != KC_NO && timer_elapsed(combo_held_event.time) >= COMBO_TERM)
+      combo_release_held();
+    matrix_scan_user();
+  }
+}
@@ -0,0 +1,332 @@
+/* Just enough of QMK to build keymap.c on the host.
+ *
+ * Keycode values, the rev6 LAYOUT_ortho_4x12 matrix and the action/record types
+ * match the QMK version the keymap is written against. Functions that touch the
+ * outside world (reports, layers, RGB, timers, raw HID) are in qmk_stub.c, which
+ * keeps the state a real board would have plus counters for the tools.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+
+enum hid_keyboard_keycodes {
+  KC_NO = 0x00, KC_TRANSPARENT = 0x01,
+  KC_A = 0x04, KC_B, KC_C, KC_D, KC_E, KC_F, KC_G, KC_H, KC_I, KC_J, KC_K, KC_L, KC_M,
+  KC_N, KC_O, KC_P, KC_Q, KC_R, KC_S, KC_T, KC_U, KC_V, KC_W, KC_X, KC_Y, KC_Z,
+  KC_1, KC_2, KC_3, KC_4, KC_5, KC_6, KC_7, KC_8, KC_9, KC_0,
+  KC_ENTER, KC_ESCAPE, KC_BSPACE, KC_TAB, KC_SPACE, KC_MINUS, KC_EQUAL, KC_LBRACKET,
+  KC_RBRACKET, KC_BSLASH, KC_NONUS_HASH, KC_SCOLON, KC_QUOTE, KC_GRAVE, KC_COMMA,
+  KC_DOT, KC_SLASH, KC_CAPSLOCK,
+  KC_F1, KC_F2, KC_F3, KC_F4, KC_F5, KC_F6, KC_F7, KC_F8, KC_F9, KC_F10, KC_F11, KC_F12,
+  KC_PSCREEN, KC_SCROLLLOCK, KC_PAUSE, KC_INSERT, KC_HOME, KC_PGUP, KC_DELETE, KC_END,
+  KC_PGDOWN, KC_RIGHT, KC_LEFT, KC_DOWN, KC_UP,
+  KC_NUMLOCK, KC_KP_SLASH, KC_KP_ASTERISK,
+  KC_AUDIO_MUTE = 0xA8, KC_AUDIO_VOL_UP, KC_AUDIO_VOL_DOWN, KC_MEDIA_NEXT_TRACK,
+  KC_MEDIA_PREV_TRACK, KC_MEDIA_STOP, KC_MEDIA_PLAY_PAUSE,
+  KC_LCTRL = 0xE0, KC_LSHIFT, KC_LALT, KC_LGUI, KC_RCTRL, KC_RSHIFT, KC_RALT, KC_RGUI,
+  KC_MS_UP = 0xF0, KC_MS_DOWN, KC_MS_LEFT, KC_MS_RIGHT, KC_MS_BTN1, KC_MS_BTN2,
+  KC_MS_BTN3, KC_MS_BTN4, KC_MS_BTN5, KC_MS_WH_UP, KC_MS_WH_DOWN, KC_MS_WH_LEFT,
+  KC_MS_WH_RIGHT, KC_MS_ACCEL0, KC_MS_ACCEL1, KC_MS_ACCEL2,
+};
+
+#define KC_TRNS KC_TRANSPARENT
+#define KC_ENT  KC_ENTER
+#define KC_ESC  KC_ESCAPE
+#define KC_BSPC KC_BSPACE
+#define KC_SPC  KC_SPACE
+#define KC_MINS KC_MINUS
+#define KC_EQL  KC_EQUAL
+#define KC_LBRC KC_LBRACKET
+#define KC_RBRC KC_RBRACKET
+#define KC_BSLS KC_BSLASH
+#define KC_SCLN KC_SCOLON
+#define KC_QUOT KC_QUOTE
+#define KC_GRV  KC_GRAVE
+#define KC_COMM KC_COMMA
+#define KC_SLSH KC_SLASH
+#define KC_CAPS KC_CAPSLOCK
+#define KC_DEL  KC_DELETE
+#define KC_PGDN KC_PGDOWN
+#define KC_RGHT KC_RIGHT
+#define KC_PAST KC_KP_ASTERISK
+#define KC_MUTE KC_AUDIO_MUTE
+#define KC_VOLU KC_AUDIO_VOL_UP
+#define KC_VOLD KC_AUDIO_VOL_DOWN
+#define KC_MNXT KC_MEDIA_NEXT_TRACK
+#define KC_MPRV KC_MEDIA_PREV_TRACK
+#define KC_MPLY KC_MEDIA_PLAY_PAUSE
+#define KC_LCTL KC_LCTRL
+#define KC_LSFT KC_LSHIFT
+#define KC_RCTL KC_RCTRL
+#define KC_RSFT KC_RSHIFT
+#define KC_MS_U KC_MS_UP
+#define KC_MS_D KC_MS_DOWN
+#define KC_MS_L KC_MS_LEFT
+#define KC_MS_R KC_MS_RIGHT
+#define KC_BTN1 KC_MS_BTN1
+#define KC_BTN2 KC_MS_BTN2
+#define KC_WH_U KC_MS_WH_UP
+#define KC_WH_D KC_MS_WH_DOWN
+#define KC_WH_L KC_MS_WH_LEFT
+#define KC_WH_R KC_MS_WH_RIGHT
+#define KC_ACL0 KC_MS_ACCEL0
+#define KC_ACL1 KC_MS_ACCEL1
+#define KC_ACL2 KC_MS_ACCEL2
+
+enum quantum_keycodes {
+  QK_MODS                 = 0x0100,
+  QK_LCTL                 = 0x0100,
+  QK_LSFT                 = 0x0200,
+  QK_LALT                 = 0x0400,
+  QK_LGUI                 = 0x0800,
+  QK_MODS_MAX             = 0x1FFF,
+  QK_TO                   = 0x5000,
+  QK_MOMENTARY            = 0x5100,
+  QK_TOGGLE_LAYER         = 0x5300,
+  QK_LAYER_TAP_TOGGLE     = 0x5800,
+  QK_LAYER_TAP_TOGGLE_MAX = 0x58FF,
+  RESET                   = 0x5C00,
+  SAFE_RANGE              = 0x5F80,
+};
+
+#define LCTL(kc) (QK_LCTL | (kc))
+#define LSFT(kc) (QK_LSFT | (kc))
+#define LALT(kc) (QK_LALT | (kc))
+#define LGUI(kc) (QK_LGUI | (kc))
+#define TO(layer) (QK_TO | (1 << 4) | ((layer) & 0xFF))
+#define MO(layer) (QK_MOMENTARY | ((layer) & 0xFF))
+#define TG(layer) (QK_TOGGLE_LAYER | ((layer) & 0xFF))
+#define TT(layer) (QK_LAYER_TAP_TOGGLE | ((layer) & 0xFF))
+
+#define KC_TILD LSFT(KC_GRV)
+#define KC_EXLM LSFT(KC_1)
+#define KC_AT   LSFT(KC_2)
+#define KC_HASH LSFT(KC_3)
+#define KC_DLR  LSFT(KC_4)
+#define KC_PERC LSFT(KC_5)
+#define KC_CIRC LSFT(KC_6)
+#define KC_AMPR LSFT(KC_7)
+#define KC_ASTR LSFT(KC_8)
+#define KC_LPRN LSFT(KC_9)
+#define KC_RPRN LSFT(KC_0)
+#define KC_UNDS LSFT(KC_MINS)
+#define KC_PLUS LSFT(KC_EQL)
+#define KC_RCBR LSFT(KC_RBRC)
+#define KC_PIPE LSFT(KC_BSLS)
+#define KC_COLN LSFT(KC_SCLN)
+#define KC_QUES LSFT(KC_SLSH)
+
+#define MOD_BIT(code) (1 << ((code) & 0x07))
+#define MOD_MASK_CTRL  (MOD_BIT(KC_LCTRL) | MOD_BIT(KC_RCTRL))
+#define MOD_MASK_SHIFT (MOD_BIT(KC_LSHIFT) | MOD_BIT(KC_RSHIFT))
+
+/* planck rev6: the right half is rows 4-7, the bottom row is wired crossed over */
+#define MATRIX_ROWS 8
+#define MATRIX_COLS 6
+#define LAYOUT_ortho_4x12( \
+    k00, k01, k02, k03, k04, k05, k06, k07, k08, k09, k0a, k0b, \
+    k10, k11, k12, k13, k14, k15, k16, k17, k18, k19, k1a, k1b, \
+    k20, k21, k22, k23, k24, k25, k26, k27, k28, k29, k2a, k2b, \
+    k30, k31, k32, k33, k34, k35, k36, k37, k38, k39, k3a, k3b) \
+  { \
+    { k00, k01, k02, k03, k04, k05 }, \
+    { k10, k11, k12, k13, k14, k15 }, \
+    { k20, k21, k22, k23, k24, k25 }, \
+    { k30, k31, k32, k39, k3a, k3b }, \
+    { k06, k07, k08, k09, k0a, k0b }, \
+    { k16, k17, k18, k19, k1a, k1b }, \
+    { k26, k27, k28, k29, k2a, k2b }, \
+    { k36, k37, k38, k33, k34, k35 }, \
+  }
+
+typedef uint32_t layer_state_t;
+extern layer_state_t layer_state;
+
+typedef struct {
+  uint8_t col;
+  uint8_t row;
+} keypos_t;
+
+typedef struct {
+  keypos_t key;
+  bool     pressed;
+  uint16_t time;
+} keyevent_t;
+
+typedef struct {
+  bool    interrupted : 1;
+  bool    reserved2 : 1;
+  bool    reserved1 : 1;
+  bool    reserved0 : 1;
+  uint8_t count : 4;
+} tap_t;
+
+typedef struct {
+  keyevent_t event;
+  tap_t      tap;
+} keyrecord_t;
+
+#define MAKE_KEYEVENT(row_num, col_num, press) \
+  ((keyevent_t){.key = ((keypos_t){.col = (col_num), .row = (row_num)}), .pressed = (press), .time = (timer_read() | 1)})
+
+#define COMBO_END 0
+typedef struct {
+  const uint16_t *keys;
+  uint16_t        keycode;
+  uint8_t         state;
+} combo_t;
+#define COMBO(ck, ca) { .keys = &(ck)[0], .keycode = (ca) }
+extern combo_t key_combos[COMBO_COUNT];
+
+#define RGBLIGHT_MODE_STATIC_LIGHT 1
+
+/* no console, the keymap's uprintf lines go nowhere */
+static inline void uprintf(const char *fmt, ...) {
+  (void)fmt;
+}
+
+/* Only for make size, which builds keymap.c with each feature flag but doesn't
+ * link it: what AUDIO_ENABLE, STENO_ENABLE and NKRO_ENABLE use, declared and
+ * nothing more. The songs are stand-ins of about the length of QMK's. */
+#ifdef AUDIO_ENABLE
+#  define NOTE(freq, duration) {(freq), (duration)}
+#  define SONG(...) {__VA_ARGS__}
+#  define PLANCK_SOUND NOTE(1318.5f, 8), NOTE(1318.5f, 8), NOTE(0, 8), NOTE(1568.0f, 16), NOTE(1975.5f, 16), NOTE(1318.5f, 32)
+#  define PLOVER_SOUND NOTE(1046.5f, 16), NOTE(1318.5f, 16), NOTE(1568.0f, 16), NOTE(2093.0f, 32)
+#  define PLOVER_GOODBYE_SOUND NOTE(2093.0f, 16), NOTE(1568.0f, 16), NOTE(1318.5f, 16), NOTE(1046.5f, 32)
+#  define NUM_LOCK_ON_SOUND NOTE(1046.5f, 8), NOTE(1568.0f, 8)
+#  define PLAY_SONG(note_array) audio_play_melody(&(note_array), sizeof(note_array) / sizeof((note_array)[0]), false)
+void audio_play_melody(float (*np)[][2], uint16_t n_count, bool n_repeat);
+void stop_all_notes(void);
+#endif
+
+#ifdef STENO_ENABLE
+enum {
+  QK_STENO = 0x5A00,
+  STN_N1   = QK_STENO, STN_N2, STN_N3, STN_N4, STN_N5, STN_N6, STN_S1, STN_S2, STN_TL, STN_KL, STN_PL, STN_WL,
+  STN_HL, STN_RL, STN_A, STN_O, STN_ST1, STN_ST2, STN_RES1, STN_RES2, STN_PWR, STN_ST3, STN_ST4, STN_E, STN_U,
+  STN_FR, STN_RR, STN_PR, STN_BR, STN_LR, STN_GR, STN_TR, STN_SR, STN_DR, STN_N7, STN_N8, STN_N9, STN_NA, STN_NB,
+  STN_NC, STN_ZR, STN_FN,
+  QK_STENO_MAX = 0x5A3F
+};
+typedef enum { STENO_MODE_BOLT, STENO_MODE_GEMINI } steno_mode_t;
+void steno_set_mode(steno_mode_t mode);
+#endif
+
+#ifdef NKRO_ENABLE
+typedef struct {
+  bool nkro;
+} keymap_config_t;
+extern keymap_config_t keymap_config;
+#endif
+
+/* the Cortex-M4 cycle counter registers CYCLE_PROFILE_ENABLE touches. On arm
+ * they're the real ones (path_bench_emu.py backs CYCCNT with an instruction
+ * count), on the host they're plain memory and CYCCNT stays 0 */
+typedef struct {
+  volatile uint32_t CTRL;
+  volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+  volatile uint32_t DHCSR;
+  volatile uint32_t DCRSR;
+  volatile uint32_t DCRDR;
+  volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk (1u << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1u << 24)
+#ifdef __arm__
+#  define DWT ((DWT_Type *)0xE0001000)
+#  define CoreDebug ((CoreDebug_Type *)0xE000EDF0)
+#else
+extern DWT_Type       stub_dwt;
+extern CoreDebug_Type stub_core_debug;
+#  define DWT (&stub_dwt)
+#  define CoreDebug (&stub_core_debug)
+#endif
+
+extern const uint16_t keymaps[][MATRIX_ROWS][MATRIX_COLS];
+
+uint8_t get_mods(void);
+void    add_mods(uint8_t mods);
+void    del_mods(uint8_t mods);
+void    set_mods(uint8_t mods);
+void    register_mods(uint8_t mods);
+void    unregister_mods(uint8_t mods);
+void    register_code(uint8_t code);
+void    unregister_code(uint8_t code);
+void    tap_code(uint8_t code);
+void    send_keyboard_report(void);
+void    clear_keyboard(void);
+void    send_char(char ascii_code);
+
+void          layer_move(uint8_t layer);
+void          layer_on(uint8_t layer);
+void          layer_off(uint8_t layer);
+void          layer_invert(uint8_t layer);
+bool          layer_state_cmp(layer_state_t state, uint8_t layer);
+bool          layer_state_is(uint8_t layer);
+uint8_t       get_highest_layer(layer_state_t state);
+layer_state_t layer_state_set_user(layer_state_t state);
+
+void    rgblight_setrgb(uint8_t r, uint8_t g, uint8_t b);
+uint8_t rgblight_get_mode(void);
+void    rgblight_mode_noeeprom(uint8_t mode);
+bool    rgblight_is_enabled(void);
+void    rgblight_enable_noeeprom(void);
+void    rgblight_disable_noeeprom(void);
+
+void combo_enable(void);
+void combo_disable(void);
+
+uint16_t timer_read(void);
+uint16_t timer_elapsed(uint16_t last);
+uint32_t timer_read32(void);
+uint32_t timer_elapsed32(uint32_t last);
+
+void action_exec(keyevent_t event);
+
+/* keymap hooks the stub drives */
+bool process_record_user(uint16_t keycode, keyrecord_t *record);
+void post_process_record_user(uint16_t keycode, keyrecord_t *record);
+void matrix_scan_user(void);
+void keyboard_post_init_user(void);
+void suspend_wakeup_init_user(void);
+
+/* host side, not QMK */
+typedef struct {
+  uint32_t reports;       // keyboard reports sent
+  uint32_t taps;          // tap_code calls, send_char counts one per character
+  uint32_t sent_chars;
+  uint32_t rgb_sets;
+} stub_counters_t;
+
+extern stub_counters_t stub_counters;
+extern uint8_t         stub_keys_down[32]; // bitmap of basic keycodes in the last report
+extern uint8_t         stub_sent_mods;     // mods in the last report
+extern uint32_t        stub_now;           // ms, advanced by stub_scan()
+extern uint8_t         stub_raw_reply[32]; // last raw_hid_send
+extern uint8_t         stub_rgb[3];
+extern uint8_t         stub_phys_mods;     // modifier keys physically down
+extern uint8_t         stub_phys_keys[32]; // other basic keys physically down that went to core
+extern bool            stub_combos;        // run key events through key_combos, off after stub_reset
+
+void     stub_reset(void);
+bool     stub_key_down(uint8_t code);
+bool     stub_any_key_down(void);
+uint16_t stub_keycode_at(uint8_t row, uint8_t col);
+bool     stub_find_key(uint16_t keycode, keypos_t *pos);
+void     stub_event(uint16_t keycode, bool pressed);
+void     stub_tap(uint16_t keycode);
+void     stub_scan(uint32_t ms);
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+void raw_hid_receive(uint8_t *data, uint8_t length);
+void raw_hid_send(uint8_t *data, uint8_t length);
@@ -0,0 +1,20 @@
+#pragma once
+
+/* What the keymap reads of tmk_core/protocol/chibios/usb_main.h and ChibiOS's
+ * USB driver state. qmk_stub.c's USBD1 is active after stub_reset(). */
+typedef enum {
+  USB_UNINIT    = 0,
+  USB_STOP      = 1,
+  USB_READY     = 2,
+  USB_SELECTED  = 3,
+  USB_ACTIVE    = 4,
+  USB_SUSPENDED = 5
+} usbstate_t;
+
+typedef struct {
+  usbstate_t state;
+} USBDriver;
+
+extern USBDriver USBD1;
+
+#define USB_DRIVER USBD1
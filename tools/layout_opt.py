@@ -0,0 +1,452 @@
+#!/usr/bin/env python3
+"""Search for cheaper combo and symbol layer placements from recorded typing.
+
+Reads the keymaps and key_combos tables out of keymap.c (as text, nothing is
+compiled), scores them against a trace with a keystroke effort plus finger
+travel model, then runs simulated annealing on every core to move combo
+outputs between adjacent key pairs and swap symbol keys around on the symbol
+layers (digits, arrows, F-keys and everything else keep their place).
+The best candidate is replayed through a small combo simulator against the
+trace timings and only proposed if it doesn't misfire more than the current
+keymap inside COMBO_TERM. The result is printed as keymap.c tables.
+
+trace format, one key press per line, # starts a comment:
+
+    <ms since start> <keycode as written in keymap.c>
+
+e.g. "1532 KC_EXLM". --text takes plain text instead and types it at about
+--ms per key (randomly spread, so some pairs land inside COMBO_TERM like real
+rolls do), which is handy to get a first idea from a pile of source code.
+"""
+
+import argparse
+import math
+import multiprocessing
+import os
+import random
+import re
+import sys
+from collections import Counter
+
+ROWS, COLS = 4, 12
+
+# relative effort per position, home row index = 1
+EFFORT = [
+    [3.0, 2.2, 1.8, 1.6, 2.0, 2.6, 2.6, 2.0, 1.6, 1.8, 2.2, 3.0],
+    [2.2, 1.3, 1.1, 1.0, 1.0, 1.6, 1.6, 1.0, 1.0, 1.1, 1.3, 2.2],
+    [2.6, 2.0, 2.0, 1.6, 1.4, 2.2, 1.8, 1.4, 1.6, 2.0, 2.0, 2.6],
+    [3.0, 2.8, 2.4, 1.6, 1.0, 1.0, 1.0, 1.0, 1.6, 2.4, 2.8, 3.0],
+]
+# finger per column, 0-7 pinky to pinky, 8/9 thumbs on the bottom row middle
+FINGER = [0, 0, 1, 2, 3, 3, 4, 4, 5, 6, 7, 7]
+
+LAYER_COST = 0.6      # holding/tapping a layer key on top of its own effort
+COMBO_COST = 0.8      # chording two keys is harder than either on its own
+SHIFT_COST = 0.4
+TRAVEL_COST = 0.5     # per key of distance moved by the same finger
+SAME_FINGER = 1.0     # two different keys in a row on one finger
+MISSING = 50.0        # keycode the layout can't produce at all
+COLLISION_COST = 20.0 # trace roll that would fire a combo
+COMBO_GAP = 5         # ms between the two presses of an intended combo
+
+SHIFTED = {
+    "KC_EXLM": "KC_1", "KC_AT": "KC_2", "KC_HASH": "KC_3", "KC_DLR": "KC_4",
+    "KC_PERC": "KC_5", "KC_CIRC": "KC_6", "KC_AMPR": "KC_7", "KC_ASTR": "KC_8",
+    "KC_LPRN": "KC_9", "KC_RPRN": "KC_0", "KC_UNDS": "KC_MINS", "KC_PLUS": "KC_EQL",
+    "KC_COLN": "KC_SCLN", "KC_DQUO": "KC_QUOT", "KC_LT": "KC_COMM", "KC_GT": "KC_DOT",
+    "KC_QUES": "KC_SLSH", "KC_LCBR": "KC_LBRC", "KC_RCBR": "KC_RBRC",
+    "KC_PIPE": "KC_BSLS", "KC_TILD": "KC_GRV",
+}
+
+CHARS = {
+    " ": "KC_SPC", "\n": "KC_ENT", "\t": "KC_TAB", "'": "KC_QUOT", ",": "KC_COMM",
+    ".": "KC_DOT", "/": "KC_SLSH", ";": "KC_SCLN", "-": "KC_MINS", "=": "KC_EQL",
+    "[": "KC_LBRC", "]": "KC_RBRC", "\\": "KC_BSLS", "`": "KC_GRV",
+    "!": "KC_EXLM", "@": "KC_AT", "#": "KC_HASH", "$": "KC_DLR", "%": "KC_PERC",
+    "^": "KC_CIRC", "&": "KC_AMPR", "*": "KC_ASTR", "(": "KC_LPRN", ")": "KC_RPRN",
+    "_": "KC_UNDS", "+": "KC_PLUS", ":": "KC_COLN", '"': "KC_DQUO", "<": "KC_LT",
+    ">": "KC_GT", "?": "KC_QUES", "{": "KC_LCBR", "}": "KC_RCBR", "|": "KC_PIPE",
+    "~": "KC_TILD",
+}
+
+# keys that never move or take part in a movable combo
+FIXED_KEY = re.compile(r"^(TO|TT|MO|OSL|LT|TG|DF)\(|^KC_(TRNS|NO|L?R?(SFT|CTL|ALT|GUI)|"
+                       r"LSHIFT|RSHIFT|LCTRL|RCTRL|SPC|ENT|ESC|TAB|BSPC)$|^(RESET|VIM_\w+|STN_\w+)$")
+
+# the only keys swapped around on a layer: punctuation, shifted or not, that
+# isn't part of a number row or numpad (see swap_slots)
+SYMBOL_KEY = {k for pair in SHIFTED.items() for k in pair if not re.match(r"^KC_\d$", k)}
+DIGIT_KEY = re.compile(r"^KC_(\d|KP_\w+|P\d|PAST|PSLS|PMNS|PPLS|PDOT|PCMM|PEQL|PENT)$")
+
+
+def finger(r, c):
+    if r == 3 and 3 <= c <= 8:
+        return 8 if c < 6 else 9
+    return FINGER[c]
+
+
+def strip_comments(src):
+    src = re.sub(r"/\*.*?\*/", "", src, flags=re.S)
+    return re.sub(r"//[^\n]*", "", src)
+
+
+def split_args(s):
+    """Split on top level commas."""
+    out, depth, cur = [], 0, ""
+    for ch in s:
+        if ch == "(":
+            depth += 1
+        elif ch == ")":
+            depth -= 1
+        if ch == "," and depth == 0:
+            out.append(cur.strip())
+            cur = ""
+        else:
+            cur += ch
+    if cur.strip():
+        out.append(cur.strip())
+    return out
+
+
+def balanced(src, start):
+    """Text between the paren at src[start] and its match."""
+    depth = 0
+    for i in range(start, len(src)):
+        if src[i] == "(":
+            depth += 1
+        elif src[i] == ")":
+            depth -= 1
+            if depth == 0:
+                return src[start + 1:i]
+    raise ValueError("unbalanced parens")
+
+
+def parse_keymap(path):
+    src = strip_comments(open(path).read())
+    layers = {}
+    for m in re.finditer(r"\[(\d+)\]\s*=\s*LAYOUT_ortho_4x12\s*\(", src):
+        n = int(m.group(1))
+        keys = split_args(balanced(src, m.end() - 1))
+        if len(keys) != ROWS * COLS:
+            raise ValueError("layer %d has %d keys" % (n, len(keys)))
+        # first definition wins, that's the #ifdef STENO_ENABLE one
+        layers.setdefault(n, keys)
+
+    arrays = {}
+    for m in re.finditer(r"uint16_t\s+PROGMEM\s+(\w+)\s*\[\s*\]\s*=\s*\{([^}]*)\}", src):
+        arrays[m.group(1)] = tuple(k for k in split_args(m.group(2)) if k != "COMBO_END")
+    combos = []
+    block = re.search(r"key_combos\s*\[[^\]]*\]\s*=\s*\{", src)
+    if block:
+        i = block.end()
+        for m in re.finditer(r"COMBO\s*\(", src[i:]):
+            name, out = split_args(balanced(src, i + m.end() - 1))
+            combos.append((name, arrays[name], out))
+    return layers, combos
+
+
+def parse_config(path):
+    m = re.search(r"#define\s+COMBO_TERM\s+(\d+)", open(path).read())
+    return int(m.group(1)) if m else 50
+
+
+def read_trace(path):
+    events = []
+    for line in open(path):
+        line = line.split("#", 1)[0].split()
+        if len(line) >= 2:
+            events.append((int(line[0]), line[1]))
+    return events
+
+
+def read_text(path, ms, seed):
+    """Type text out with roughly --ms between keys, fast rolls included."""
+    rng = random.Random(seed)
+    events, t = [], 0
+    for ch in open(path, errors="replace").read():
+        if ch.isalpha() and ch.isascii():
+            kc = "KC_" + ch.upper()
+        elif ch.isdigit():
+            kc = "KC_" + ch
+        else:
+            kc = CHARS.get(ch)
+        if kc:
+            events.append((t, kc))
+            t += max(1, int(rng.gauss(ms, ms / 2)))
+    return events
+
+
+class Model:
+    """Everything about the trace and the fixed part of the keymap the cost needs."""
+
+    def __init__(self, layers, combos, events, term, movable_layers):
+        self.base = layers[0]
+        self.term = term
+        self.movable_layers = movable_layers
+        self.layer_keys = {}
+        for n in layers:
+            best = None
+            for i, k in enumerate(self.base):
+                if re.match(r"(MO|TT|OSL|LT)\(%d\b" % n, k):
+                    cost = EFFORT[i // COLS][i % COLS] + LAYER_COST
+                    best = cost if best is None else min(best, cost)
+            if best is not None:
+                self.layer_keys[n] = best
+        shifts = [EFFORT[i // COLS][i % COLS] for i, k in enumerate(self.base)
+                  if k in ("KC_LSFT", "KC_RSFT", "KC_LSHIFT", "KC_RSHIFT")]
+        self.shift = (min(shifts) if shifts else 3.0) + SHIFT_COST
+
+        self.slots = {n: self.swap_slots(layers[n]) for n in movable_layers if n in layers}
+        self.fixed_combos = [c for c in combos if not self.combo_movable(c)]
+        self.pairs = self.candidate_pairs(combos)
+
+        self.unigrams = Counter(kc for _, kc in events)
+        self.bigrams = Counter()
+        self.fast = Counter()
+        for (t0, a), (t1, b) in zip(events, events[1:]):
+            self.bigrams[(a, b)] += 1
+            if t1 - t0 < term:
+                self.fast[(a, b)] += 1
+        self.events = events
+
+    @staticmethod
+    def swap_slots(keys):
+        """Positions of the symbol keys that may swap. A symbol in an unbroken run
+        of digits and symbols along a row is a numpad operator or decimal point and
+        stays next to its digits."""
+        pinned = set()
+        for r in range(ROWS):
+            row = range(r * COLS, (r + 1) * COLS)
+            run = []
+            for i in list(row) + [None]:
+                if i is not None and (keys[i] in SYMBOL_KEY or DIGIT_KEY.match(keys[i])):
+                    run.append(i)
+                    continue
+                if any(DIGIT_KEY.match(keys[j]) for j in run):
+                    pinned.update(run)
+                run = []
+        return [i for i, k in enumerate(keys) if k in SYMBOL_KEY and i not in pinned]
+
+    def combo_movable(self, combo):
+        _, keys, out = combo
+        return (len(keys) == 2 and re.match(r"^KC_\w+$", out) and out != "KC_CAPS"
+                and all(not FIXED_KEY.match(k) or k == "KC_BSPC" for k in keys))
+
+    def candidate_pairs(self, combos):
+        """Adjacent base layer key pairs a combo could live on."""
+        taken = {frozenset(c[1]) for c in self.fixed_combos}
+        pairs = {tuple(c[1]) for c in combos if self.combo_movable(c)}
+        for r in range(ROWS - 1):
+            for c in range(COLS):
+                for r2, c2 in ((r, c + 1), (r + 1, c)):
+                    if r2 >= ROWS - 1 or c2 >= COLS:
+                        continue
+                    a, b = self.base[r * COLS + c], self.base[r2 * COLS + c2]
+                    if FIXED_KEY.match(a) or FIXED_KEY.match(b) or a == b:
+                        continue
+                    if frozenset((a, b)) not in taken:
+                        pairs.add((a, b))
+        return sorted(pairs)
+
+    def ways(self, state):
+        """Cheapest way to produce each keycode.
+
+        Maps keycode -> (cost, position of the last key, base layer keycodes
+        pressed for it or None when it comes from another layer).
+        """
+        layers, combos = state
+        best = {}
+
+        def offer(kc, cost, pos, presses):
+            if kc not in best or cost < best[kc][0]:
+                best[kc] = (cost, pos, presses)
+
+        for i, k in enumerate(self.base):
+            offer(k, EFFORT[i // COLS][i % COLS], i, (k,))
+        for n, keys in layers.items():
+            if n not in self.layer_keys:
+                continue
+            for i, k in enumerate(keys):
+                offer(k, EFFORT[i // COLS][i % COLS] + self.layer_keys[n], i, None)
+        where = {k: i for i, k in enumerate(self.base)}
+        for keys, out in combos + [(c[1], c[2]) for c in self.fixed_combos]:
+            if all(k in where for k in keys):
+                cost = sum(EFFORT[where[k] // COLS][where[k] % COLS] for k in keys)
+                offer(out, cost + COMBO_COST, where[keys[-1]], tuple(keys))
+        for shifted, plain in SHIFTED.items():
+            if plain in best:
+                offer(shifted, best[plain][0] + self.shift, best[plain][1], best[plain][2])
+        return best
+
+    def collisions(self, combos, counts):
+        hit = 0
+        sets = {frozenset(keys) for keys, _ in combos}
+        sets.update(frozenset(c[1]) for c in self.fixed_combos)
+        for (a, b), n in counts.items():
+            if a != b and frozenset((a, b)) in sets:
+                hit += n
+        return hit
+
+    def cost(self, state):
+        ways = self.ways(state)
+        total = 0.0
+        for kc, n in self.unigrams.items():
+            total += n * (ways[kc][0] if kc in ways else MISSING)
+        for (a, b), n in self.bigrams.items():
+            if a in ways and b in ways:
+                p, q = ways[a][1], ways[b][1]
+                if p != q and finger(p // COLS, p % COLS) == finger(q // COLS, q % COLS):
+                    dist = math.hypot(p // COLS - q // COLS, p % COLS - q % COLS)
+                    total += n * (SAME_FINGER + TRAVEL_COST * dist)
+        return total + COLLISION_COST * self.collisions(state[1], self.fast)
+
+    def simulate(self, state):
+        """Replay the trace as physical presses and count combos that fire by accident.
+
+        Mirrors what process_combo does: a combo fires when all its keys go
+        down within COMBO_TERM of the first one with nothing else in between.
+        Intended combos are pressed COMBO_GAP ms apart and always fire.
+        """
+        ways = self.ways(state)
+        sets = {frozenset(keys) for keys, _ in state[1]}
+        sets.update(frozenset(c[1]) for c in self.fixed_combos)
+        presses = []
+        for n, (t, kc) in enumerate(self.events):
+            keys = ways[kc][2] if kc in ways else None
+            if keys is None:
+                presses.append((t, None, n))
+            else:
+                presses += [(t + COMBO_GAP * i, k, n) for i, k in enumerate(keys)]
+        misfires = 0
+        for (t0, a, n0), (t1, b, n1) in zip(presses, presses[1:]):
+            if n0 != n1 and a and b and t1 - t0 < self.term and frozenset((a, b)) in sets:
+                misfires += 1
+        return misfires
+
+
+def initial_state(model, layers, combos):
+    movable = {n: list(layers[n]) for n in model.movable_layers if n in layers}
+    return movable, [(c[1], c[2]) for c in combos if model.combo_movable(c)]
+
+
+def neighbour(model, state, rng):
+    layers, combos = state
+    layers = {n: list(k) for n, k in layers.items()}
+    combos = list(combos)
+    if combos and (not layers or rng.random() < 0.5):
+        i = rng.randrange(len(combos))
+        used = {frozenset(k) for k, _ in combos}
+        free = [p for p in model.pairs if frozenset(p) not in used]
+        if free and rng.random() < 0.5:
+            combos[i] = (rng.choice(free), combos[i][1])
+        else:
+            j = rng.randrange(len(combos))
+            combos[i], combos[j] = (combos[i][0], combos[j][1]), (combos[j][0], combos[i][1])
+    else:
+        n = rng.choice(sorted(layers))
+        slots = model.slots[n]
+        if len(slots) >= 2:
+            a, b = rng.sample(slots, 2)
+            layers[n][a], layers[n][b] = layers[n][b], layers[n][a]
+    return layers, combos
+
+
+def anneal(args):
+    model, state, seed, steps = args
+    rng = random.Random(seed)
+    cur, cur_cost = state, model.cost(state)
+    best, best_cost = cur, cur_cost
+    temp0 = max(cur_cost * 0.002, 1.0)
+    for step in range(steps):
+        temp = temp0 * (1 - step / steps) + 1e-6
+        cand = neighbour(model, cur, rng)
+        cost = model.cost(cand)
+        if cost < cur_cost or rng.random() < math.exp((cur_cost - cost) / temp):
+            cur, cur_cost = cand, cost
+            if cost < best_cost:
+                best, best_cost = cand, cost
+    return best_cost, seed, best
+
+
+def c_name(keys):
+    return "".join(k.replace("KC_", "").lower()[:4] for k in keys) + "_combo"
+
+
+def emit(model, layers_in, combos_in, state, out):
+    layers, combos = state
+    for n in sorted(layers):
+        if layers[n] == layers_in[n]:
+            continue
+        keys = layers[n]
+        rows = [", ".join(keys[r * COLS:(r + 1) * COLS]) for r in range(ROWS)]
+        out.write("        [%d] = LAYOUT_ortho_4x12(%s,\n" % (n, rows[0]))
+        for r in rows[1:-1]:
+            out.write("                                %s,\n" % r)
+        out.write("                                %s),\n\n" % rows[-1])
+
+    entries, names = [], {}
+    movable = iter(combos)
+    for name, keys, outkc in combos_in:
+        if model.combo_movable((name, keys, outkc)):
+            keys, outkc = next(movable)
+            name = next((n for n, k, _ in combos_in if frozenset(k) == frozenset(keys)), c_name(keys))
+        names[name] = keys
+        entries.append((name, outkc))
+    for name, keys in names.items():
+        out.write("const uint16_t PROGMEM %s[] = {%s, COMBO_END};\n" % (name, ", ".join(keys)))
+    out.write("\ncombo_t key_combos[COMBO_COUNT] = {\n")
+    out.write(",\n".join("    COMBO(%s,%s%s)" % (n, " " * max(1, 12 - len(n)), o) for n, o in entries))
+    out.write("\n};\n")
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    ap.add_argument("trace", help="trace file, or text with --text")
+    ap.add_argument("--text", action="store_true", help="trace is plain text")
+    ap.add_argument("--ms", type=int, default=80, help="average ms per key for --text")
+    ap.add_argument("--keymap", default=os.path.join(here, "..", "keymap.c"))
+    ap.add_argument("--config", default=os.path.join(here, "..", "config.h"))
+    ap.add_argument("--layers", default="1,2", help="layers whose symbol keys may move")
+    ap.add_argument("--steps", type=int, default=20000, help="annealing steps per run")
+    ap.add_argument("--runs", type=int, default=os.cpu_count(), help="independent runs")
+    ap.add_argument("--jobs", type=int, default=os.cpu_count())
+    ap.add_argument("--seed", type=int, default=1)
+    args = ap.parse_args()
+
+    layers, combos = parse_keymap(args.keymap)
+    term = parse_config(args.config)
+    events = read_text(args.trace, args.ms, args.seed) if args.text else read_trace(args.trace)
+    if len(events) < 2:
+        sys.exit("trace has no key presses")
+    movable = [int(n) for n in args.layers.split(",") if n]
+    model = Model(layers, combos, events, term, movable)
+    start = initial_state(model, layers, combos)
+    start_cost, start_misfires = model.cost(start), model.simulate(start)
+
+    jobs = [(model, start, args.seed + i, args.steps) for i in range(args.runs)]
+    with multiprocessing.Pool(args.jobs) as pool:
+        results = sorted(pool.imap_unordered(anneal, jobs), key=lambda r: (r[0], r[1]))
+
+    # only propose something the simulator doesn't like less than what's there now
+    for cost, seed, state in results:
+        misfires = model.simulate(state)
+        if misfires <= start_misfires:
+            break
+    else:
+        sys.exit("no candidate passed the COMBO_TERM check")
+
+    log = sys.stderr
+    log.write("%d key presses, COMBO_TERM %dms, %d runs x %d steps on %d jobs\n"
+              % (len(events), term, args.runs, args.steps, args.jobs))
+    log.write("current:   cost %.0f, %d combo misfires\n" % (start_cost, start_misfires))
+    log.write("candidate: cost %.0f (%.1f%%), %d combo misfires, seed %d\n"
+              % (cost, 100.0 * (cost - start_cost) / start_cost, misfires, seed))
+    if state == start:
+        log.write("nothing better found, keymap.c is already the best candidate\n")
+        return
+    emit(model, layers, combos, state, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,294 @@
+/* Key event cost of profile_script (profile_script.h) off the board.
+ *
+ * Replays the script through keymap.c on the stub the way ctrl+F10 does on the
+ * board, one key event per scan with each key looked up on the top layer, and
+ * times every action_exec. The cost is per layer the key was looked up on and,
+ * built with CYCLE_PROFILE_ENABLE, per profiler path (events a combo held back
+ * never reach the keymap and have no path). Combos are on. The stub's stand-in
+ * for QMK core (combo matching, register_code, layer changes) is timed too.
+ *
+ * On the host (build/path_bench) the cost is ns, the least each event took over
+ * the rounds with the clock's own overhead taken off. -i counts x86-64
+ * instructions instead by single stepping (the trap flag, a SIGTRAP per
+ * instruction), slow but the same every run, so it shows small changes the ns
+ * are too noisy for:
+ *
+ *   path_bench [-v] [-i] [rounds]
+ *
+ * Built for cortex-m4 (build/path_bench.elf, make emu) there's no main:
+ * path_bench_emu.py calls bench_run() in Unicorn and reads bench_events back, and
+ * the cost is instructions, the emulator backs DWT->CYCCNT with its count.
+ *
+ * The script comes from the tree so make path_bench REV=<commit> can replay it
+ * against keymap.c at another commit, without the profiler.
+ */
+#ifndef __arm__
+#  include <signal.h>
+#  include <stdio.h>
+#  include <stdlib.h>
+#  include <time.h>
+#  include <unistd.h>
+#endif
+
+#ifndef KEYMAP_C
+#  define KEYMAP_C "keymap.c"
+#endif
+#include KEYMAP_C
+#include "profile_script.h"
+
+#define BENCH_MAX_EVENTS (PROFILE_SCRIPT_LEN * 4)
+#define BENCH_NO_PATH 0xFF
+#define BENCH_LAYERS 32
+
+typedef struct {
+  uint32_t cost;
+  uint16_t keycode;
+  uint8_t  layer; // looked up on
+  uint8_t  path;  // enum profile_path, BENCH_NO_PATH if none
+  bool     pressed;
+} bench_event_t;
+
+// path_bench_emu.py reads these as "<IHBB?3x"
+_Static_assert(sizeof(bench_event_t) == 12, "bench_event_t layout");
+
+/* kept out of the snapshot so the rounds can keep the least cost */
+__attribute__((section("bench_stats"))) bench_event_t bench_events[BENCH_MAX_EVENTS];
+__attribute__((section("bench_stats"))) uint16_t bench_event_count;
+__attribute__((section("bench_stats"))) uint16_t bench_missing; // the key bench_round didn't find
+
+#ifdef __arm__
+static uint32_t bench_start(void) {
+  return DWT->CYCCNT;
+}
+
+static uint32_t bench_stop(void) {
+  return DWT->CYCCNT;
+}
+#else
+static bool              bench_instructions; // -i
+static volatile uint32_t bench_steps;
+
+static void bench_trap(int sig) {
+  (void)sig;
+  bench_steps++;
+}
+
+static uint32_t bench_clock(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+static uint32_t bench_start(void) {
+  if (!bench_instructions)
+    return bench_clock();
+  uint32_t steps = bench_steps;
+#  ifdef __x86_64__
+  // past the red zone, the compiler may have something there
+  __asm__ volatile("sub $128, %%rsp; pushfq; orq $0x100, (%%rsp); popfq; add $128, %%rsp" ::: "memory", "cc");
+#  endif
+  return steps;
+}
+
+static uint32_t bench_stop(void) {
+  if (!bench_instructions)
+    return bench_clock();
+#  ifdef __x86_64__
+  __asm__ volatile("sub $128, %%rsp; pushfq; andq $~0x100, (%%rsp); popfq; add $128, %%rsp" ::: "memory", "cc");
+#  endif
+  return bench_steps;
+}
+#endif
+
+static bool bench_find(uint16_t keycode, uint8_t layer, keypos_t *key) {
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+      if (pgm_read_word(&keymaps[layer][row][col]) == keycode) {
+        key->row = row;
+        key->col = col;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/* up and on the admin layer, where ctrl+F10 starts the script on the board */
+static void bench_setup(void) {
+  stub_reset();
+  keyboard_post_init_user();
+  stub_scan(STARTUP_DEFER + 1);
+  stub_tap(TO(7));
+  stub_combos = true;
+  for (uint16_t i = 0; i < BENCH_MAX_EVENTS; i++)
+    bench_events[i].cost = UINT32_MAX;
+}
+
+/* 0, or 1 + the step with a key that isn't on the top layer */
+static int bench_round(void) {
+  uint16_t n = 0;
+  for (uint8_t step = 0; step < PROFILE_SCRIPT_LEN; step++) {
+    uint16_t keycodes[2] = {pgm_read_word(&profile_script[step].first), pgm_read_word(&profile_script[step].second)};
+    uint8_t  keys        = keycodes[1] == KC_NO ? 1 : 2;
+    keypos_t pos[2];
+    uint8_t  layer[2];
+
+    for (uint8_t phase = 0; phase < 2 * keys; phase++) {
+      uint8_t i       = phase % keys;
+      bool    pressed = phase < keys;
+      if (pressed) {
+        layer[i] = get_highest_layer(layer_state);
+        if (!bench_find(keycodes[i], layer[i], &pos[i])) {
+          bench_missing = keycodes[i];
+          return step + 1;
+        }
+      }
+#ifdef CYCLE_PROFILE_ENABLE
+      profile_path = BENCH_NO_PATH;
+#endif
+      uint32_t start = bench_start();
+      action_exec(MAKE_KEYEVENT(pos[i].row, pos[i].col, pressed));
+      uint32_t cost = bench_stop() - start;
+
+      bench_event_t *e = &bench_events[n++];
+      e->keycode = keycodes[i];
+      e->layer   = layer[i];
+      e->pressed = pressed;
+#ifdef CYCLE_PROFILE_ENABLE
+      e->path = profile_path;
+#else
+      e->path = BENCH_NO_PATH;
+#endif
+      if (cost < e->cost)
+        e->cost = cost;
+      stub_scan(1);
+    }
+  }
+  bench_event_count = n;
+  return 0;
+}
+
+/* the emulator's way in */
+int bench_run(void) {
+  bench_setup();
+  return bench_round();
+}
+
+#ifndef __arm__
+extern char __start_keymap_data[], __stop_keymap_data[];
+extern char __start_keymap_bss[], __stop_keymap_bss[];
+
+typedef struct {
+  uint32_t count;
+  uint64_t total;
+  uint32_t max;
+} bucket_t;
+
+static void add(bucket_t *b, uint32_t cost) {
+  b->count++;
+  b->total += cost;
+  if (cost > b->max)
+    b->max = cost;
+}
+
+static void print_bucket(const char *name, const bucket_t *b) {
+  printf("%-6s  %8u %8llu %8u\n", name, b->count, (unsigned long long)(b->count ? b->total / b->count : 0), b->max);
+}
+
+/* the least a start and a stop in a row take, taken off every event */
+static uint32_t clock_overhead(void) {
+  uint32_t least = UINT32_MAX;
+  for (int i = 0; i < (bench_instructions ? 10 : 10000); i++) {
+    uint32_t start = bench_start(), cost = bench_stop() - start;
+    if (cost < least)
+      least = cost;
+  }
+  return least;
+}
+
+int main(int argc, char **argv) {
+  int  opt;
+  bool verbose = false;
+  while ((opt = getopt(argc, argv, "vi")) != -1) {
+    if (opt == 'v') {
+      verbose = true;
+    } else if (opt == 'i') {
+      bench_instructions = true;
+    } else {
+      fprintf(stderr, "usage: %s [-v] [-i] [rounds]\n", argv[0]);
+      return 2;
+    }
+  }
+  long rounds = optind < argc ? atol(argv[optind]) : bench_instructions ? 2 : 1000;
+  if (rounds < 1) {
+    fprintf(stderr, "usage: %s [-v] [-i] [rounds]\n", argv[0]);
+    return 2;
+  }
+#  ifndef __x86_64__
+  if (bench_instructions) {
+    fprintf(stderr, "path_bench: -i is x86-64 only\n");
+    return 2;
+  }
+#  endif
+  if (bench_instructions)
+    signal(SIGTRAP, bench_trap);
+
+  bench_setup();
+  size_t data_size = __stop_keymap_data - __start_keymap_data;
+  size_t bss_size  = __stop_keymap_bss - __start_keymap_bss;
+  char  *snapshot  = malloc(data_size + bss_size);
+  if (!snapshot) {
+    perror("path_bench");
+    return 2;
+  }
+  memcpy(snapshot, __start_keymap_data, data_size);
+  memcpy(snapshot + data_size, __start_keymap_bss, bss_size);
+
+  uint32_t overhead = clock_overhead();
+  for (long r = 0; r < rounds; r++) {
+    memcpy(__start_keymap_data, snapshot, data_size);
+    memcpy(__start_keymap_bss, snapshot + data_size, bss_size);
+    int failed = bench_round();
+    if (failed) {
+      fprintf(stderr, "step %d: %04x isn't on the top layer\n", failed - 1, bench_missing);
+      return 1;
+    }
+  }
+
+  bucket_t by_layer[BENCH_LAYERS] = {0};
+  bucket_t by_path[BENCH_NO_PATH] = {0};
+  bool     paths                  = false;
+  for (uint16_t i = 0; i < bench_event_count; i++) {
+    bench_event_t *e = &bench_events[i];
+    e->cost          = e->cost > overhead ? e->cost - overhead : 0;
+    add(&by_layer[e->layer], e->cost);
+    if (e->path != BENCH_NO_PATH) {
+      add(&by_path[e->path], e->cost);
+      paths = true;
+    }
+    if (verbose)
+      printf("%3u %04x %-4s layer %2u path %3u %8u\n", i, e->keycode, e->pressed ? "down" : "up", e->layer,
+             e->path, e->cost);
+  }
+
+  printf("%zu steps, %u key events, %s each (least of %ld rounds)\n", PROFILE_SCRIPT_LEN, bench_event_count,
+         bench_instructions ? "x86-64 instructions" : "ns", rounds);
+  printf("layer     events      avg      max\n");
+  for (uint8_t layer = 0; layer < BENCH_LAYERS; layer++) {
+    char name[8];
+    snprintf(name, sizeof(name), "%u", layer);
+    if (by_layer[layer].count)
+      print_bucket(name, &by_layer[layer]);
+  }
+#ifdef CYCLE_PROFILE_ENABLE
+  if (paths) {
+    printf("path      events      avg      max\n");
+    for (uint8_t path = 0; path < PATH_COUNT; path++)
+      print_bucket(profile_path_names[path], &by_path[path]);
+  }
+#else
+  (void)paths;
+#endif
+  return 0;
+}
+#endif
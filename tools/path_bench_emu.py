@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""Run build/path_bench.elf (path_bench.c built for cortex-m4) in Unicorn.
+
+Loads the elf's segments, calls bench_run() once, the way path_bench's main
+does a round on the pc, and prints the same tables with the cost in
+instructions: DWT->CYCCNT reads give the emulator's instruction count. That's
+not cycles (no flash wait states, every instruction counts one), but it moves
+with the code the way the cycle count on the board does, and two builds can be
+compared without one.
+
+    path_bench_emu.py [-v] build/path_bench.elf
+
+make -C tools emu builds the elf and runs this, needs arm-none-eabi-gcc and
+python3 -m pip install unicorn.
+"""
+
+import argparse
+import struct
+import sys
+
+try:
+    import unicorn
+    from unicorn import arm_const
+except ImportError:
+    sys.exit("path_bench_emu: needs unicorn, python3 -m pip install unicorn")
+
+FLASH, FLASH_SIZE = 0x08000000, 256 * 1024  # host/cm4.ld
+RAM, RAM_SIZE = 0x20000000, 40 * 1024
+SCS = 0xE000E000  # CoreDebug and the rest of the system control space
+DWT, DWT_CYCCNT = 0xE0001000, 4
+RETURN = FLASH + FLASH_SIZE - 4  # bench_run returns here, stops the emulator
+BENCH_NO_PATH = 0xFF
+EVENT = struct.Struct("<IHBB?3x")  # bench_event_t
+
+
+class Elf:
+    """Just enough of a 32-bit little endian elf: PT_LOAD segments and symbols."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:6] != b"\x7fELF\x01\x01":
+            sys.exit(f"{path}: not a 32-bit little endian elf")
+        (self.phoff, self.shoff) = struct.unpack_from("<II", self.data, 28)
+        (self.phentsize, self.phnum, self.shentsize, self.shnum) = struct.unpack_from("<4H", self.data, 42)
+        self.symbols = self.read_symbols()
+
+    def segments(self):
+        for i in range(self.phnum):
+            kind, offset, vaddr, paddr, filesz, memsz = struct.unpack_from("<6I", self.data, self.phoff + i * self.phentsize)
+            if kind == 1 and filesz:
+                # .data is linked to run from ram but loaded at its flash address, put it
+                # where it runs since there's no startup code to copy it
+                yield vaddr, self.data[offset : offset + filesz]
+
+    def section(self, i):
+        return struct.unpack_from("<10I", self.data, self.shoff + i * self.shentsize)
+
+    def read_symbols(self):
+        symbols = {}
+        for i in range(self.shnum):
+            _, kind, _, _, offset, size, link, _, _, entsize = self.section(i)
+            if kind != 2:  # SHT_SYMTAB
+                continue
+            strings = self.section(link)[4]
+            for at in range(offset, offset + size, entsize):
+                name, value, sym_size, _, _, _ = struct.unpack_from("<IIIBBH", self.data, at)
+                end = self.data.index(b"\0", strings + name)
+                symbols[self.data[strings + name : end].decode()] = (value, sym_size)
+        return symbols
+
+    def symbol(self, name):
+        if name not in self.symbols:
+            sys.exit(f"path_bench_emu: no {name} in the elf")
+        return self.symbols[name]
+
+
+def run(elf):
+    uc = unicorn.Uc(unicorn.UC_ARCH_ARM, unicorn.UC_MODE_THUMB | unicorn.UC_MODE_MCLASS)
+    cortex_m4 = getattr(arm_const, "UC_CPU_ARM_CORTEX_M4", None)
+    if cortex_m4 is not None:
+        uc.ctl_set_cpu_model(cortex_m4)
+    uc.mem_map(FLASH, FLASH_SIZE)
+    uc.mem_map(RAM, RAM_SIZE)
+    try:
+        uc.mem_map(SCS, 0x1000)
+    except unicorn.UcError:
+        pass  # some unicorn versions map the system control space themselves
+    for address, data in elf.segments():
+        uc.mem_write(address, data)
+
+    count = [0]
+
+    def code(uc, address, size, user):
+        count[0] += 1
+
+    def dwt_read(uc, offset, size, user):
+        return count[0] & 0xFFFFFFFF if offset == DWT_CYCCNT else 0
+
+    def dwt_write(uc, offset, size, value, user):
+        pass
+
+    uc.hook_add(unicorn.UC_HOOK_CODE, code)
+    uc.mmio_map(DWT, 0x1000, dwt_read, None, dwt_write, None)
+
+    uc.reg_write(arm_const.UC_ARM_REG_SP, RAM + RAM_SIZE)
+    uc.reg_write(arm_const.UC_ARM_REG_LR, RETURN | 1)
+    uc.emu_start(elf.symbol("bench_run")[0] | 1, RETURN)
+    return uc, uc.reg_read(arm_const.UC_ARM_REG_R0), count[0]
+
+
+def read_u16(uc, elf, name):
+    return struct.unpack("<H", uc.mem_read(elf.symbol(name)[0], 2))[0]
+
+
+def read_string(uc, address):
+    out = b""
+    while True:
+        byte = bytes(uc.mem_read(address + len(out), 1))
+        if byte == b"\0":
+            return out.decode()
+        out += byte
+
+
+def print_buckets(title, buckets, names):
+    print(title)
+    for key in names:
+        costs = buckets.get(key, [])
+        avg = sum(costs) // len(costs) if costs else 0
+        print(f"{names[key]:<6}  {len(costs):8} {avg:8} {max(costs, default=0):8}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("-v", action="store_true", help="print every key event")
+    parser.add_argument("elf")
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    uc, failed, total = run(elf)
+    if failed:
+        missing = read_u16(uc, elf, "bench_missing")
+        sys.exit(f"step {failed - 1}: {missing:04x} isn't on the top layer")
+
+    events_at = elf.symbol("bench_events")[0]
+    by_layer, by_path = {}, {}
+    for i in range(read_u16(uc, elf, "bench_event_count")):
+        cost, keycode, layer, path, pressed = EVENT.unpack(uc.mem_read(events_at + i * EVENT.size, EVENT.size))
+        by_layer.setdefault(layer, []).append(cost)
+        if path != BENCH_NO_PATH:
+            by_path.setdefault(path, []).append(cost)
+        if args.v:
+            print(f"{i:3} {keycode:04x} {'down' if pressed else 'up':<4} layer {layer:2} path {path:3} {cost:8}")
+
+    steps = elf.symbol("profile_script")[1] // 4
+    print(f"{steps} steps, {sum(map(len, by_layer.values()))} key events, "
+          f"instructions each (cortex-m4 in unicorn, {total} in all)")
+    print_buckets("layer     events      avg      max", by_layer, {layer: str(layer) for layer in sorted(by_layer)})
+    if by_path and "profile_path_names" in elf.symbols:
+        names_at, names_size = elf.symbol("profile_path_names")
+        names = {}
+        for path in range(names_size // 4):
+            (address,) = struct.unpack("<I", uc.mem_read(names_at + path * 4, 4))
+            names[path] = read_string(uc, address)
+        print_buckets("path      events      avg      max", by_path, names)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,147 @@
+/* Report count benchmark for the vim layer.
+ *
+ * Types one command per handle_cmd case on the vim layer and counts the
+ * keyboard reports and tap_code calls it costs, so a change to the mod
+ * handling can be checked against the keymap before it:
+ *
+ *   make -C tools bench                 # the keymap.c in the tree
+ *   make -C tools bench REV=<commit>    # keymap.c at some other commit
+ *
+ * Only process_record_user and the layer calls are used, so this builds
+ * against older keymaps too. Every case starts from a fresh stub, layer 0 then
+ * layer 3 and a VIM_ESC, none of which is counted. Shifted characters are
+ * typed with a real left shift, its own down and up reports are in the count
+ * (two per shifted character, the same on both sides of a comparison). The
+ * scan loop runs for a couple of seconds after each command so anything the
+ * keymap paces out over later scans is counted too.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef KEYMAP_C
+#  define KEYMAP_C "keymap.c"
+#endif
+#include KEYMAP_C
+
+#define SETTLE_MS 2000
+
+typedef struct {
+  const char *name;  // the handle_cmd case
+  const char *setup; // typed before counting starts
+  const char *keys;  // what's counted
+} bench_case_t;
+
+static const bench_case_t cases[] = {
+  {"h/j/k/l", "", "j"},
+  {"{n}j", "", "5j"},
+  {"dl", "", "dl"},
+  {"{n}yl", "", "3yl"},
+  {"cl", "", "cl"},
+  {"w/e", "", "w"},
+  {"dw", "", "dw"},
+  {"{n}dw", "", "3dw"},
+  {"yw", "", "yw"},
+  {"cw", "", "cw"},
+  {"b", "", "b"},
+  {"db", "", "db"},
+  {"v", "", "v"},
+  {"a", "", "a"},
+  {"i", "", "i"},
+  {"/", "", "/"},
+  {"u", "", "u"},
+  {"o", "", "o"},
+  {"D", "", "D"},
+  {"C", "", "C"},
+  {"I", "", "I"},
+  {"A", "", "A"},
+  {"O", "", "O"},
+  {"p", "", "p"},
+  {"\\", "", "\\"},
+  {"dd", "", "dd"},
+  {"{n}dd", "", "3dd"},
+  {"yy", "", "yy"},
+  {"x", "", "x"},
+  {"{n}x", "", "5x"},
+  {"X", "", "X"},
+  {"0", "", "0"},
+  {"$", "", "$"},
+  {"d$", "", "d$"},
+  {"y$", "", "y$"},
+  {"G", "", "G"},
+  {"gg", "", "gg"},
+  {"r", "", "r"},
+  {". (dw)", "dw", "."},
+};
+
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+static const struct {
+  char     c;
+  uint16_t keycode;
+  bool     shift;
+} chars[] = {
+  {'0', KC_0, false}, {'1', KC_1, false}, {'2', KC_2, false}, {'3', KC_3, false},
+  {'4', KC_4, false}, {'5', KC_5, false}, {'6', KC_6, false}, {'7', KC_7, false},
+  {'8', KC_8, false}, {'9', KC_9, false}, {'$', KC_4, true},  {'^', KC_6, true},
+  {'.', KC_DOT, false}, {'/', KC_SLSH, false}, {'\\', KC_BSLS, false},
+};
+
+static void type_char(char c) {
+  uint16_t keycode = KC_NO;
+  bool     shift   = false;
+  if (c >= 'a' && c <= 'z') {
+    keycode = KC_A + (c - 'a');
+  } else if (c >= 'A' && c <= 'Z') {
+    keycode = KC_A + (c - 'A');
+    shift   = true;
+  } else {
+    for (size_t i = 0; i < sizeof(chars) / sizeof(chars[0]); i++) {
+      if (chars[i].c == c) {
+        keycode = chars[i].keycode;
+        shift   = chars[i].shift;
+      }
+    }
+  }
+  if (keycode == KC_NO) {
+    fprintf(stderr, "report_bench: can't type '%c'\n", c);
+    exit(2);
+  }
+  if (shift)
+    stub_event(KC_LSFT, true);
+  stub_tap(keycode);
+  if (shift)
+    stub_event(KC_LSFT, false);
+  stub_scan(1);
+}
+
+static void type(const char *keys) {
+  for (; *keys; keys++)
+    type_char(*keys);
+  stub_scan(SETTLE_MS);
+}
+
+int main(void) {
+  stub_counters_t total = {0};
+
+  stub_reset();
+  keyboard_post_init_user();
+  stub_scan(SETTLE_MS);
+
+  printf("%-10s %-6s %8s %6s\n", "case", "keys", "reports", "taps");
+  for (size_t i = 0; i < CASE_COUNT; i++) {
+    stub_reset();
+    layer_move(0);
+    layer_move(3);
+    stub_tap(VIM_ESC);
+    type(cases[i].setup);
+
+    memset(&stub_counters, 0, sizeof(stub_counters));
+    type(cases[i].keys);
+    printf("%-10s %-6s %8u %6u\n", cases[i].name, cases[i].keys, stub_counters.reports, stub_counters.taps);
+    total.reports += stub_counters.reports;
+    total.taps += stub_counters.taps;
+  }
+  printf("%-10s %-6s %8u %6u\n", "total", "", total.reports, total.taps);
+  return 0;
+}
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""Print what each part of keymap.c costs in flash and ram, for make size.
+
+Takes keymap.c built with no feature flags and once per flag (size-<FLAG>.o,
+see the Makefile). A flag's row is how much bigger its object is than the one
+without. The always built parts (vim layer, combos, snippets and so on) are
+split out of the flagless object by symbol name. Flash is text + data (data
+is copied out of flash at startup), ram is data + bss. QMK's own side of a
+feature (the audio driver, steno protocol, combo matching) isn't in keymap.c
+and isn't counted, qmk compile's totals have that.
+
+    size_table.py [--prefix arm-none-eabi-] build/size-base.o build/size-AUDIO.o ...
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+# first match wins, anything left over is "other"
+GROUPS = [
+    ("keymaps", r"^keymaps$|^layer_colours$"),
+    ("combos", r"_combo$|^key_combos$"),
+    ("snippets", r"^snippet"),
+    ("scroll", r"scroll"),
+    ("startup", r"^startup|^first_key|^usb_active|^resume|^suspend|keyboard_post_init"),
+    ("gaming/steno", r"^gaming|^steno"),
+    ("vim", r"vim|cmd|^os_|tap_|held_motion|^repeat_|goto|line_burst|insert|mods_tx|hold_mods|mod_type|"
+            r"_num$|_char|core_key"),
+]
+
+
+def run(tool, path):
+    try:
+        return subprocess.run([tool] + path, check=True, capture_output=True, text=True).stdout
+    except (OSError, subprocess.CalledProcessError) as e:
+        sys.exit(f"size_table: {tool}: {e}")
+
+
+def totals(prefix, obj):
+    """(flash, ram) from size's berkeley format"""
+    text, data, bss = map(int, run(prefix + "size", [obj]).splitlines()[1].split()[:3])
+    return text + data, data + bss
+
+
+def groups(prefix, obj):
+    """{group: [flash, ram]} by symbol, data counts for both"""
+    out = {name: [0, 0] for name, _ in GROUPS + [("other", None)]}
+    for line in run(prefix + "nm", ["-S", "-t", "d", obj]).splitlines():
+        fields = line.split()
+        if len(fields) != 4:
+            continue
+        size, kind, name = int(fields[1]), fields[2].lower(), fields[3]
+        group = next((g for g, pattern in GROUPS if re.search(pattern, name)), "other")
+        if kind in "tr":
+            out[group][0] += size
+        elif kind == "d":
+            out[group][0] += size
+            out[group][1] += size
+        elif kind in "bc":
+            out[group][1] += size
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--prefix", default="", help="binutils prefix, arm-none-eabi- for the board's")
+    parser.add_argument("base", help="keymap.c built with no feature flags")
+    parser.add_argument("features", nargs="*", help="size-<FLAG>.o, the same with -D<FLAG>_ENABLE")
+    args = parser.parse_args()
+
+    base_flash, base_ram = totals(args.prefix, args.base)
+    print(f"keymap.c built by {args.prefix + 'gcc' if args.prefix else 'the host compiler'}, bytes")
+    print("part                     flash      ram")
+    for name, (flash, ram) in groups(args.prefix, args.base).items():
+        print(f"{name:<20} {flash:10} {ram:8}")
+    print(f"{'total':<20} {base_flash:10} {base_ram:8}   no flags, string literals included")
+    print()
+    print("flag                     flash      ram")
+    for obj in args.features:
+        flag = re.sub(r"^size-|\.o$", "", os.path.basename(obj)) + "_ENABLE"
+        flash, ram = totals(args.prefix, obj)
+        print(f"{flag:<20} {flash - base_flash:+10} {ram - base_ram:+8}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,118 @@
+/* Per key cost of the snippet trigger matcher.
+ *
+ * Feeds text through snippet_feed() the way the base layer does (one call per
+ * key press) and prints the host time per key plus the most trie nodes one key
+ * can look at, which is what bounds it on the board. The text is plain prose,
+ * then prose full of commas (every one is a possible trigger start), then every
+ * trigger in snippets.txt typed out. Fired snippets are dropped rather than
+ * typed so only the matching is timed. Exits 1 if the prose set anything off or
+ * a trigger didn't fire.
+ *
+ *   snippet_bench [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "keymap.c"
+
+#define SNIPPET_COUNT (sizeof(snippets) / sizeof(snippets[0]))
+#define NODE_COUNT (sizeof(snippet_trie) / sizeof(snippet_trie[0]))
+
+static const char prose[] =
+  "the quick brown fox jumps over the lazy dog while the vim layer keeps track "
+  "of what was typed and nothing here should ever go off because none of it "
+  "starts with two commas in a row ";
+
+static const char commas[] =
+  "one, two, three, four, five,six,seven, eight,,nine ,ten, a,b,c,d,e,f,g,,x "
+  "lists, like, this, one, are, the, worst, case, for, the, matcher,, ok ";
+
+static uint16_t keycode_for(char c) {
+  if (c >= 'a' && c <= 'z')
+    return KC_A + (c - 'a');
+  if (c == ',')
+    return KC_COMM;
+  return KC_SPC;
+}
+
+/* the triggers, read back out of the trie so the bench doesn't need snippets.txt */
+static size_t triggers(uint16_t *out, uint8_t node, char *path, int depth) {
+  size_t n = 0;
+  for (uint8_t i = snippet_trie[node].child; i != 0; i = snippet_trie[i].next) {
+    path[depth] = snippet_trie[i].c;
+    if (snippet_trie[i].snippet != 0) {
+      for (int d = 0; d <= depth; d++)
+        out[n++] = keycode_for(path[d]);
+      out[n++] = KC_SPC;
+    } else {
+      n += triggers(out + n, i, path, depth + 1);
+    }
+  }
+  return n;
+}
+
+/* a key can walk its node's children, then the root's after a miss */
+static unsigned worst_nodes(void) {
+  unsigned root = 0, most = 0;
+  for (uint8_t i = snippet_trie[0].child; i != 0; i = snippet_trie[i].next)
+    root++;
+  for (size_t n = 1; n < NODE_COUNT; n++) {
+    unsigned kids = 0;
+    for (uint8_t i = snippet_trie[n].child; i != 0; i = snippet_trie[i].next)
+      kids++;
+    if (kids > most)
+      most = kids;
+  }
+  return most + root;
+}
+
+static unsigned long bench(const char *name, const uint16_t *keys, size_t count, long rounds) {
+  unsigned long fired = 0;
+  struct timespec start, end;
+  snippet_state = snippet_depth = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (long r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < count; i++) {
+      snippet_feed(keys[i]);
+      if (snippet_out != NULL) {
+        fired++;
+        snippet_out   = NULL;
+        snippet_erase = 0;
+      }
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  printf("%-9s %8zu %10.2f %8lu\n", name, count, ns / ((double)count * rounds), fired / rounds);
+  return fired / rounds;
+}
+
+static size_t to_keys(const char *text, uint16_t *out) {
+  size_t n = 0;
+  for (; *text; text++)
+    out[n++] = keycode_for(*text);
+  return n;
+}
+
+int main(int argc, char **argv) {
+  long rounds = argc > 1 ? atol(argv[1]) : 20000;
+  static uint16_t keys[1024];
+  char path[64];
+  if (rounds < 1) {
+    fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+    return 2;
+  }
+
+  stub_reset();
+  printf("%zu snippets, %zu trie nodes (%zu bytes), at most %u nodes looked at per key\n",
+         SNIPPET_COUNT, NODE_COUNT, sizeof(snippet_trie), worst_nodes());
+  printf("%-9s %8s %10s %8s\n", "text", "keys", "ns/key", "fired");
+  unsigned long stray = bench("prose", keys, to_keys(prose, keys), rounds);
+  stray += bench("commas", keys, to_keys(commas, keys), rounds);
+  size_t n = triggers(keys, 0, path, 0);
+  unsigned long fired = bench("triggers", keys, n, rounds);
+
+  // nothing but the triggers should go off, and each of them once
+  return stray == 0 && fired == SNIPPET_COUNT ? 0 : 1;
+}
@@ -0,0 +1,496 @@
+/* Offline analysis of a binary trace dump (see trace_format.h).
+ *
+ * The file is mmapped and split into -j contiguous chunks of records, one
+ * thread each, reading the records in place. Every thread keeps its own
+ * tallies, which are merged in chunk order at the end, so the output doesn't
+ * depend on -j. It prints:
+ *
+ *   - key event latency per path: p50/p90/p99/max in cycles and us
+ *   - the most run vim commands
+ *   - per combo: how often it fired, how close the presses were to COMBO_TERM
+ *     and how many look like a roll that misfired (the first key was let go
+ *     before the keys had been down together as long as it took to press them)
+ *   - time spent on each layer
+ *
+ * Timing of the run itself goes to stderr so stdout can be diffed.
+ *
+ *   trace_analyze [-j threads] [-n top] trace.bin
+ *   trace_analyze -g out.bin [records]     # write a synthetic trace
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace_format.h"
+
+#define MAX_LAYERS 32
+#define MAX_COMBOS 64
+#define GAP_BUCKETS 256 // ms, combo press gaps past this go in the last one
+#define CMD_SLOTS 1024  // distinct vim commands a table starts with, power of two
+
+static const char *const path_names[TRACE_PATH_COUNT] = {
+  [TRACE_PATH_DIRECT] = "direct",
+  [TRACE_PATH_VIM]    = "vim",
+  [TRACE_PATH_ADMIN]  = "admin",
+  [TRACE_PATH_LAYER]  = "layer",
+  [TRACE_PATH_PASS]   = "pass",
+};
+
+typedef struct {
+  uint32_t *v;
+  size_t    len;
+  size_t    cap;
+} u32_vec_t;
+
+typedef struct {
+  uint32_t cmd;
+  uint64_t count;
+} cmd_slot_t;
+
+// open addressing, doubles when half full so there's always a free slot to stop on
+typedef struct {
+  cmd_slot_t *slots;
+  size_t      cap;
+  size_t      used;
+} cmd_table_t;
+
+typedef struct {
+  uint64_t fired;
+  uint64_t rolled;
+  uint64_t gaps[GAP_BUCKETS];
+} combo_stats_t;
+
+typedef struct {
+  const trace_record_t *records;
+  size_t                count;
+  bool                  failed;
+
+  u32_vec_t     cycles[TRACE_PATH_COUNT];
+  cmd_table_t   cmds;
+  combo_stats_t combos[MAX_COMBOS];
+  uint64_t      bad_records;
+
+  // layer changes inside the chunk, the ends are stitched together later
+  bool     has_layer;
+  uint32_t first_layer_time;
+  uint8_t  last_layer;
+  uint32_t last_layer_time;
+  uint64_t dwell[MAX_LAYERS];
+} chunk_t;
+
+static bool vec_push(u32_vec_t *vec, uint32_t x) {
+  if (vec->len == vec->cap) {
+    size_t    cap = vec->cap ? vec->cap * 2 : 1024;
+    uint32_t *v   = realloc(vec->v, cap * sizeof(*v));
+    if (!v)
+      return false;
+    vec->v   = v;
+    vec->cap = cap;
+  }
+  vec->v[vec->len++] = x;
+  return true;
+}
+
+static cmd_slot_t *cmd_slot(cmd_slot_t *slots, size_t cap, uint32_t cmd) {
+  size_t i = (cmd * 2654435761u) & (cap - 1);
+  while (slots[i].count != 0 && slots[i].cmd != cmd)
+    i = (i + 1) & (cap - 1);
+  return &slots[i];
+}
+
+static bool cmd_add(cmd_table_t *t, uint32_t cmd, uint64_t count) {
+  if (t->used >= t->cap / 2) {
+    size_t      cap   = t->cap ? t->cap * 2 : CMD_SLOTS;
+    cmd_slot_t *slots = calloc(cap, sizeof(*slots));
+    if (!slots)
+      return false;
+    for (size_t i = 0; i < t->cap; i++)
+      if (t->slots[i].count)
+        *cmd_slot(slots, cap, t->slots[i].cmd) = t->slots[i];
+    free(t->slots);
+    t->slots = slots;
+    t->cap   = cap;
+  }
+  cmd_slot_t *slot = cmd_slot(t->slots, t->cap, cmd);
+  if (slot->count == 0) {
+    slot->cmd = cmd;
+    t->used++;
+  }
+  slot->count += count;
+  return true;
+}
+
+static void *analyze_chunk(void *arg) {
+  chunk_t *c = arg;
+  for (size_t i = 0; i < c->count; i++) {
+    const trace_record_t *r = &c->records[i];
+    switch (r->kind) {
+      case TRACE_KEY:
+        if (r->arg >= TRACE_PATH_COUNT) {
+          c->bad_records++;
+        } else if (!vec_push(&c->cycles[r->arg], r->value)) {
+          c->failed = true;
+          return NULL;
+        }
+        break;
+      case TRACE_VIM_CMD:
+        if (!cmd_add(&c->cmds, r->value, 1)) {
+          c->failed = true;
+          return NULL;
+        }
+        break;
+      case TRACE_COMBO: {
+        if (r->arg >= MAX_COMBOS) {
+          c->bad_records++;
+          break;
+        }
+        combo_stats_t *s = &c->combos[r->arg];
+        s->fired++;
+        s->gaps[r->value < GAP_BUCKETS ? r->value : GAP_BUCKETS - 1]++;
+        if (r->extra < r->value)
+          s->rolled++;
+        break;
+      }
+      case TRACE_LAYER:
+        if (r->arg >= MAX_LAYERS) {
+          c->bad_records++;
+          break;
+        }
+        if (!c->has_layer) {
+          c->has_layer        = true;
+          c->first_layer_time = r->time;
+        } else {
+          c->dwell[c->last_layer] += r->time - c->last_layer_time;
+        }
+        c->last_layer      = r->arg;
+        c->last_layer_time = r->time;
+        break;
+      default:
+        c->bad_records++;
+    }
+  }
+  return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static int cmp_cmd(const void *a, const void *b) {
+  const cmd_slot_t *x = a, *y = b;
+  if (x->count != y->count)
+    return x->count < y->count ? 1 : -1;
+  return x->cmd < y->cmd ? -1 : x->cmd > y->cmd;
+}
+
+/* nearest rank */
+static uint32_t percentile(const u32_vec_t *v, unsigned pct) {
+  size_t rank = (v->len * pct + 99) / 100;
+  return v->v[rank ? rank - 1 : 0];
+}
+
+static uint32_t gap_percentile(const uint64_t *gaps, uint64_t total, unsigned pct) {
+  uint64_t rank = (total * pct + 99) / 100, seen = 0;
+  for (uint32_t ms = 0; ms < GAP_BUCKETS; ms++) {
+    seen += gaps[ms];
+    if (seen >= rank && seen != 0)
+      return ms;
+  }
+  return GAP_BUCKETS - 1;
+}
+
+static void cmd_name(uint32_t cmd, char out[5]) {
+  int n = 0;
+  for (int i = 0; i < 4; i++) {
+    char ch = (cmd >> (8 * i)) & 0xFF;
+    if (ch)
+      out[n++] = ch >= ' ' && ch < 127 ? ch : '?';
+  }
+  out[n] = 0;
+}
+
+static int analyze(const char *file, int threads, int top) {
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    perror(file);
+    return 2;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    perror(file);
+    return 2;
+  }
+  if ((size_t)st.st_size < sizeof(trace_header_t)) {
+    fprintf(stderr, "%s: too short for a trace header\n", file);
+    return 2;
+  }
+  const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror(file);
+    return 2;
+  }
+  const trace_header_t *h = (const trace_header_t *)map;
+  if (memcmp(h->magic, TRACE_MAGIC, sizeof(h->magic)) != 0 || h->version != TRACE_VERSION ||
+      h->record_size != sizeof(trace_record_t)) {
+    fprintf(stderr, "%s: not a version %d trace\n", file, TRACE_VERSION);
+    return 2;
+  }
+  size_t count = h->count;
+  if (count > (st.st_size - sizeof(*h)) / sizeof(trace_record_t)) {
+    fprintf(stderr, "%s: header says %zu records but the file is cut short\n", file, count);
+    return 2;
+  }
+  const trace_record_t *records = (const trace_record_t *)(map + sizeof(*h));
+  madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if ((size_t)threads > count)
+    threads = count ? count : 1;
+  chunk_t   *chunks = calloc(threads, sizeof(*chunks));
+  pthread_t *tids   = calloc(threads, sizeof(*tids));
+  if (!chunks || !tids) {
+    perror("trace_analyze");
+    return 2;
+  }
+  for (int t = 0; t < threads; t++) {
+    size_t from      = count * t / threads;
+    chunks[t].records = records + from;
+    chunks[t].count   = count * (t + 1) / threads - from;
+    if (pthread_create(&tids[t], NULL, analyze_chunk, &chunks[t]) != 0) {
+      perror("trace_analyze");
+      return 2;
+    }
+  }
+  for (int t = 0; t < threads; t++)
+    pthread_join(tids[t], NULL);
+
+  // merge in chunk order
+  u32_vec_t      cycles[TRACE_PATH_COUNT] = {0};
+  cmd_table_t    cmds   = {0};
+  combo_stats_t *combos = calloc(MAX_COMBOS, sizeof(*combos));
+  uint64_t       dwell[MAX_LAYERS] = {0};
+  uint64_t       bad = 0, cmd_total = 0;
+  uint8_t        layer = 0;
+  uint32_t       since = count ? records[0].time : 0;
+  if (!combos) {
+    perror("trace_analyze");
+    return 2;
+  }
+  for (int t = 0; t < threads; t++) {
+    chunk_t *c = &chunks[t];
+    if (c->failed) {
+      perror("trace_analyze");
+      return 2;
+    }
+    bad += c->bad_records;
+    for (int p = 0; p < TRACE_PATH_COUNT; p++) {
+      for (size_t i = 0; i < c->cycles[p].len; i++) {
+        if (!vec_push(&cycles[p], c->cycles[p].v[i])) {
+          perror("trace_analyze");
+          return 2;
+        }
+      }
+      free(c->cycles[p].v);
+    }
+    for (size_t i = 0; i < c->cmds.cap; i++) {
+      cmd_slot_t *slot = &c->cmds.slots[i];
+      if (slot->count == 0)
+        continue;
+      if (!cmd_add(&cmds, slot->cmd, slot->count)) {
+        perror("trace_analyze");
+        return 2;
+      }
+      cmd_total += slot->count;
+    }
+    free(c->cmds.slots);
+    for (int i = 0; i < MAX_COMBOS; i++) {
+      combos[i].fired += c->combos[i].fired;
+      combos[i].rolled += c->combos[i].rolled;
+      for (int ms = 0; ms < GAP_BUCKETS; ms++)
+        combos[i].gaps[ms] += c->combos[i].gaps[ms];
+    }
+    if (c->has_layer) {
+      dwell[layer] += c->first_layer_time - since;
+      for (int l = 0; l < MAX_LAYERS; l++)
+        dwell[l] += c->dwell[l];
+      layer = c->last_layer;
+      since = c->last_layer_time;
+    }
+  }
+  if (count)
+    dwell[layer] += records[count - 1].time - since;
+
+  for (int p = 0; p < TRACE_PATH_COUNT; p++)
+    if (cycles[p].len)
+      qsort(cycles[p].v, cycles[p].len, sizeof(uint32_t), cmp_u32);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  double mhz = h->cycles_per_us ? h->cycles_per_us : 1;
+  printf("%zu records, COMBO_TERM %ums, %u MHz, %llu unreadable\n", count, h->combo_term, h->cycles_per_us,
+         (unsigned long long)bad);
+
+  printf("\npath      events      p50      p90      p99      max   p99 us\n");
+  for (int p = 0; p < TRACE_PATH_COUNT; p++) {
+    u32_vec_t *v = &cycles[p];
+    if (!v->len) {
+      printf("%-6s  %8u %8s %8s %8s %8s %8s\n", path_names[p], 0, "-", "-", "-", "-", "-");
+      continue;
+    }
+    printf("%-6s  %8zu %8u %8u %8u %8u %8.1f\n", path_names[p], v->len, percentile(v, 50), percentile(v, 90),
+           percentile(v, 99), v->v[v->len - 1], percentile(v, 99) / mhz);
+  }
+
+  size_t used = 0;
+  for (size_t i = 0; i < cmds.cap; i++)
+    if (cmds.slots[i].count)
+      cmds.slots[used++] = cmds.slots[i];
+  qsort(cmds.slots, used, sizeof(*cmds.slots), cmp_cmd);
+  printf("\nvim cmd      count  share\n");
+  for (size_t i = 0; i < used && i < (size_t)top; i++) {
+    char name[5];
+    cmd_name(cmds.slots[i].cmd, name);
+    printf("%-8s  %8llu  %4.1f%%\n", name, (unsigned long long)cmds.slots[i].count,
+           100.0 * cmds.slots[i].count / cmd_total);
+  }
+
+  printf("\ncombo     fired  gap p50  gap p90  near term   rolled\n");
+  for (int i = 0; i < MAX_COMBOS; i++) {
+    combo_stats_t *s = &combos[i];
+    if (!s->fired)
+      continue;
+    // within the last quarter of COMBO_TERM, a slightly slower roll wouldn't have fired
+    uint64_t near = 0;
+    for (int ms = h->combo_term - h->combo_term / 4; ms < GAP_BUCKETS && ms <= h->combo_term; ms++)
+      near += s->gaps[ms];
+    printf("%5d  %8llu  %5ums  %5ums  %9llu %8llu\n", i, (unsigned long long)s->fired,
+           gap_percentile(s->gaps, s->fired, 50), gap_percentile(s->gaps, s->fired, 90),
+           (unsigned long long)near, (unsigned long long)s->rolled);
+  }
+
+  uint64_t total_dwell = 0;
+  for (int l = 0; l < MAX_LAYERS; l++)
+    total_dwell += dwell[l];
+  printf("\nlayer          ms  share\n");
+  for (int l = 0; l < MAX_LAYERS; l++)
+    if (dwell[l])
+      printf("%5d  %10llu  %4.1f%%\n", l, (unsigned long long)dwell[l], 100.0 * dwell[l] / total_dwell);
+
+  fprintf(stderr, "%zu records in %.3fs with %d threads, %.0f records/s\n", count, secs, threads, count / secs);
+  munmap((void *)map, st.st_size);
+  return bad ? 1 : 0;
+}
+
+/* xorshift, so the same count always gives the same file */
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rng(uint32_t below) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (uint32_t)(rng_state % below);
+}
+
+static int generate(const char *file, size_t count) {
+  static const char *const vim_cmds[] = {"j", "k", "w", "b", "dw", "dd", "yy", "p", "x", "u", "3j", "cw", "gg", "G", "$", "0"};
+  static const uint8_t     layers[]   = {0, 3, 0, 1, 0, 4, 0, 7, 0, 3};
+  static const uint32_t    base[]     = {[TRACE_PATH_DIRECT] = 300, [TRACE_PATH_VIM] = 2500, [TRACE_PATH_ADMIN] = 900,
+                                         [TRACE_PATH_LAYER] = 1200, [TRACE_PATH_PASS] = 700};
+
+  FILE *f = fopen(file, "wb");
+  if (!f) {
+    perror(file);
+    return 2;
+  }
+  trace_header_t h = {.version = TRACE_VERSION, .record_size = sizeof(trace_record_t), .combo_term = 20,
+                      .cycles_per_us = 72, .count = count};
+  memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+  fwrite(&h, sizeof(h), 1, f);
+
+  uint32_t now = 1000;
+  uint8_t  layer_at = 0;
+  for (size_t i = 0; i < count; i++) {
+    trace_record_t r = {0};
+    now += 20 + rng(180);
+    r.time = now;
+    uint32_t pick = rng(100);
+    if (pick < 80) {
+      r.kind    = TRACE_KEY;
+      r.arg     = rng(TRACE_PATH_COUNT);
+      r.keycode = 4 + rng(40);
+      // mostly near the path's usual cost with a long tail
+      r.value   = base[r.arg] + rng(base[r.arg] / 2) + (rng(100) == 0 ? rng(base[r.arg] * 8) : 0);
+      r.extra   = rng(2);
+    } else if (pick < 90) {
+      // a quarter are {n}G, enough distinct commands that the tables have to grow
+      char        jump[5];
+      const char *cmd = vim_cmds[rng(sizeof(vim_cmds) / sizeof(vim_cmds[0]))];
+      if (rng(4) == 0) {
+        snprintf(jump, sizeof(jump), "%uG", 1 + rng(999));
+        cmd = jump;
+      }
+      r.kind = TRACE_VIM_CMD;
+      for (int c = 0; cmd[c] && c < 4; c++)
+        r.value |= (uint32_t)(uint8_t)cmd[c] << (8 * c);
+    } else if (pick < 97) {
+      r.kind    = TRACE_COMBO;
+      r.arg     = rng(16);
+      r.keycode = 0x21E + r.arg;
+      r.value   = rng(h.combo_term + 1);
+      r.extra   = rng(100);
+    } else {
+      r.kind = TRACE_LAYER;
+      r.arg  = layers[layer_at++ % sizeof(layers)];
+    }
+    if (fwrite(&r, sizeof(r), 1, f) != 1) {
+      perror(file);
+      return 2;
+    }
+  }
+  if (fclose(f) != 0) {
+    perror(file);
+    return 2;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int opt, threads = sysconf(_SC_NPROCESSORS_ONLN), top = 20;
+  const char *gen = NULL;
+  while ((opt = getopt(argc, argv, "g:j:n:")) != -1) {
+    switch (opt) {
+      case 'g':
+        gen = optarg;
+        break;
+      case 'j':
+        threads = atoi(optarg);
+        break;
+      case 'n':
+        top = atoi(optarg);
+        break;
+      default:
+        goto usage;
+    }
+  }
+  if (gen)
+    return generate(gen, optind < argc ? strtoull(argv[optind], NULL, 10) : 1000000);
+  if (optind != argc - 1 || threads < 1)
+    goto usage;
+  return analyze(argv[optind], threads, top);
+
+usage:
+  fprintf(stderr, "usage: %s [-j threads] [-n top] trace.bin\n       %s -g out.bin [records]\n", argv[0], argv[0]);
+  return 2;
+}
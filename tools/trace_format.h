@@ -0,0 +1,67 @@
+/* Binary trace dump format read by trace_analyze.
+ *
+ * A trace is one trace_header_t followed by header.count trace_record_t, all
+ * little endian (what the rev6 and any x86/arm host are anyway) and packed with
+ * no padding, so a file can be mmapped and used as an array as is. Records are
+ * in time order. trace_analyze -g writes a synthetic one in this format.
+ *
+ * What each kind puts in the fields:
+ *
+ *   TRACE_KEY      a key event through process_record_user
+ *                  arg = path (same order as enum profile_path in keymap.c),
+ *                  keycode, value = cycles it took, extra = 1 for a press
+ *   TRACE_VIM_CMD  a vim command that ran (handle_cmd returned true)
+ *                  value = the last up to 4 characters of vim.cmd, first one
+ *                  in the low byte, 0 padded
+ *   TRACE_COMBO    a combo fired
+ *                  arg = index into key_combos, keycode = what it sent,
+ *                  value = ms between its first and last key going down,
+ *                  extra = ms all its keys were down together
+ *   TRACE_LAYER    vim.last_layer_on changed
+ *                  arg = the new layer
+ */
+#pragma once
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "PLNKTRC1"
+#define TRACE_VERSION 1
+
+typedef struct __attribute__((packed)) {
+  char     magic[8];      // TRACE_MAGIC, no terminator
+  uint32_t version;       // TRACE_VERSION
+  uint32_t record_size;   // sizeof(trace_record_t), for sanity
+  uint16_t combo_term;    // COMBO_TERM (ms) of the build that recorded it
+  uint16_t cycles_per_us; // core clock in MHz, 72 on the rev6
+  uint32_t reserved;
+  uint64_t count;         // records that follow
+} trace_header_t;
+
+enum trace_kind {
+  TRACE_KEY,
+  TRACE_VIM_CMD,
+  TRACE_COMBO,
+  TRACE_LAYER,
+  TRACE_KIND_COUNT
+};
+
+enum trace_path {
+  TRACE_PATH_DIRECT,
+  TRACE_PATH_VIM,
+  TRACE_PATH_ADMIN,
+  TRACE_PATH_LAYER,
+  TRACE_PATH_PASS,
+  TRACE_PATH_COUNT
+};
+
+typedef struct __attribute__((packed)) {
+  uint32_t time;    // ms since power on (timer_read32)
+  uint8_t  kind;    // enum trace_kind
+  uint8_t  arg;
+  uint16_t keycode;
+  uint32_t value;
+  uint32_t extra;
+} trace_record_t;
+
+_Static_assert(sizeof(trace_header_t) == 32, "trace header layout");
+_Static_assert(sizeof(trace_record_t) == 16, "trace record layout");
@@ -0,0 +1,417 @@
+/* Bounded depth state space explorer for the vim layer.
+ *
+ * Builds keymap.c against the host stub, puts the board in the vim layer and
+ * then tries every sequence of up to N steps from a fixed alphabet (taps, mod
+ * and motion key downs/ups, raw HID hints) through process_record_user, running
+ * the scan loop after each step until the keymap stops sending. After every
+ * step it checks:
+ *
+ *   - no modifier transaction is left open
+ *   - the mods in the last report are the mods the keymap has, and those are
+ *     exactly the modifier keys physically down (nothing stuck, nothing lost)
+ *   - no key is down in the report unless it's physically held
+ *   - the command/save buffers and the tap queue are in bounds, and the tap
+ *     queue has drained
+ *   - a VIM_ESC tap always ends in COMMAND_MODE with an empty command
+ *   - after r, a tap of anything but a layer key (those leave the vim layer) or
+ *     a basic key going down ends in COMMAND_MODE
+ *
+ * State is everything keymap.c and the stub keep: the Makefile moves this
+ * object's .data/.bss into keymap_data/keymap_bss so a snapshot is two memcpys
+ * and nothing is missed when the keymap grows new globals. States are deduped
+ * on a 64 bit hash of that snapshot, re-expanded only if reached again with
+ * more steps left. The first steps are dealt round robin to -j forked workers,
+ * each with its own seen set, so a state can be counted by more than one of
+ * them. Time doesn't pass: held repeats, snippet pacing and the startup delay
+ * aren't part of the search.
+ *
+ *   vim_explore [-d depth] [-j jobs] [-v]
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "keymap.c"
+
+extern char __start_keymap_data[], __stop_keymap_data[];
+extern char __start_keymap_bss[], __stop_keymap_bss[];
+
+enum step_kind { TAP, DOWN, UP, HINT };
+
+typedef struct {
+  const char *name;
+  uint16_t    keycode;
+  uint8_t     kind;
+} step_t;
+
+static const step_t steps[] = {
+  {"h", KC_H, TAP}, {"j", KC_J, TAP}, {"k", KC_K, TAP}, {"l", KC_L, TAP},
+  {"w", KC_W, TAP}, {"e", KC_E, TAP}, {"b", KC_B, TAP}, {"v", KC_V, TAP},
+  {"d", KC_D, TAP}, {"c", KC_C, TAP}, {"y", KC_Y, TAP}, {"x", KC_X, TAP},
+  {"u", KC_U, TAP}, {"o", KC_O, TAP}, {"p", KC_P, TAP}, {"n", KC_N, TAP},
+  {"r", KC_R, TAP}, {"g", KC_G, TAP}, {"i", KC_I, TAP}, {"a", KC_A, TAP},
+  {".", KC_DOT, TAP}, {"/", KC_SLSH, TAP}, {"1", KC_1, TAP}, {"0", KC_0, TAP},
+  {"$", KC_DLR, TAP}, {";", KC_SCLN, TAP}, {":", KC_COLN, TAP},
+  {"enter", KC_ENT, TAP}, {"esc", KC_ESC, TAP}, {"VIM_ESC", VIM_ESC, TAP},
+  {"TO(0)", TO(0), TAP}, {"TT(3)", TT(3), TAP},
+  {"lshift+", KC_LSFT, DOWN}, {"lshift-", KC_LSFT, UP},
+  {"rshift+", KC_RSFT, DOWN}, {"rshift-", KC_RSFT, UP},
+  {"lctrl+", KC_LCTL, DOWN}, {"lctrl-", KC_LCTL, UP},
+  {"rctrl+", KC_RCTL, DOWN}, {"rctrl-", KC_RCTL, UP},
+  {"lgui+", KC_LGUI, DOWN}, {"lgui-", KC_LGUI, UP},
+  {"VIM_NUM+", VIM_NUM, DOWN}, {"VIM_NUM-", VIM_NUM, UP},
+  {"j+", KC_J, DOWN}, {"j-", KC_J, UP},
+  {"w+", KC_W, DOWN}, {"w-", KC_W, UP},
+  {"hint:text", HINT_TEXT_FIELD, HINT}, {"hint:vim", HINT_TERMINAL_VIM, HINT},
+  {"hint:sel", HINT_SELECTION_ON, HINT}, {"hint:nosel", HINT_SELECTION_OFF, HINT},
+  {"hint:reset", HINT_RESET, HINT},
+};
+
+#define STEP_COUNT (sizeof(steps) / sizeof(steps[0]))
+#define MAX_DEPTH 16
+#define MAX_DRAIN_SCANS 4096
+#define MAX_REPORTED 5
+
+/* keys the search is holding down, part of the state like everything else here */
+static uint64_t held;
+
+/* bookkeeping that must survive restoring a snapshot */
+typedef struct {
+  int       depth;
+  int       worker;
+  int       workers;
+  bool      verbose;
+  uint8_t   path[MAX_DEPTH];
+  char     *snapshots;
+  size_t    data_size;
+  size_t    bss_size;
+  uint64_t *seen_hash;
+  uint8_t  *seen_left;
+  size_t    seen_cap;
+  size_t    seen_count;
+  uint64_t  events;
+  uint64_t  violations;
+  char      report[MAX_REPORTED][256];
+} run_t;
+
+__attribute__((section("explore_run"))) static run_t run;
+
+typedef struct {
+  uint64_t states;
+  uint64_t events;
+  uint64_t violations;
+  char     report[MAX_REPORTED][256];
+} result_t;
+
+static void save(char *buf) {
+  memcpy(buf, __start_keymap_data, run.data_size);
+  memcpy(buf + run.data_size, __start_keymap_bss, run.bss_size);
+}
+
+static void restore(const char *buf) {
+  memcpy(__start_keymap_data, buf, run.data_size);
+  memcpy(__start_keymap_bss, buf + run.data_size, run.bss_size);
+}
+
+static uint64_t hash_state(void) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (const char *p = __start_keymap_data; p < __stop_keymap_data; p++)
+    h = (h ^ (uint8_t)*p) * 0x100000001b3ull;
+  for (const char *p = __start_keymap_bss; p < __stop_keymap_bss; p++)
+    h = (h ^ (uint8_t)*p) * 0x100000001b3ull;
+  return h;
+}
+
+static void seen_grow(void);
+
+/* true if the state is new or now has more steps left than last time */
+static bool visit(uint64_t h, uint8_t left) {
+  if (run.seen_count * 2 >= run.seen_cap)
+    seen_grow();
+  if (h == 0)
+    h = 1;
+  size_t i = h & (run.seen_cap - 1);
+  while (run.seen_hash[i] != 0 && run.seen_hash[i] != h)
+    i = (i + 1) & (run.seen_cap - 1);
+  if (run.seen_hash[i] == 0) {
+    run.seen_hash[i] = h;
+    run.seen_left[i] = left;
+    run.seen_count++;
+    return true;
+  }
+  if (run.seen_left[i] >= left)
+    return false;
+  run.seen_left[i] = left;
+  return true;
+}
+
+static void seen_grow(void) {
+  uint64_t *old_hash = run.seen_hash;
+  uint8_t  *old_left = run.seen_left;
+  size_t    old_cap  = run.seen_cap;
+  run.seen_cap   = old_cap ? old_cap * 2 : 1 << 16;
+  run.seen_hash  = calloc(run.seen_cap, sizeof(*run.seen_hash));
+  run.seen_left  = calloc(run.seen_cap, sizeof(*run.seen_left));
+  run.seen_count = 0;
+  if (!run.seen_hash || !run.seen_left) {
+    perror("vim_explore");
+    exit(2);
+  }
+  for (size_t i = 0; i < old_cap; i++)
+    if (old_hash[i])
+      visit(old_hash[i], old_left[i]);
+  free(old_hash);
+  free(old_left);
+}
+
+static bool reachable(uint16_t keycode) {
+  keypos_t pos;
+  if (keycode == KC_COLN) // the l+' combo
+    return stub_find_key(KC_L, &pos) && stub_find_key(KC_QUOT, &pos);
+  return stub_find_key(keycode, &pos);
+}
+
+static bool holding(uint16_t keycode) {
+  for (unsigned i = 0; i < STEP_COUNT; i++)
+    if (steps[i].kind == UP && steps[i].keycode == keycode && (held & (1ull << i)))
+      return true;
+  return false;
+}
+
+static bool step_valid(const step_t *s, unsigned index) {
+  uint64_t bit = 1ull << index;
+  switch (s->kind) {
+    case TAP:
+      return !holding(s->keycode) && reachable(s->keycode);
+    case DOWN:
+      // the matching up is the next entry
+      return !(held & (bit << 1)) && reachable(s->keycode);
+    case UP:
+      return held & bit;
+  }
+  return true;
+}
+
+/* scan until the keymap has nothing more to send */
+static void drain(void) {
+  uint32_t last = stub_counters.reports;
+  for (int quiet = 0, i = 0; quiet < 2 && i < MAX_DRAIN_SCANS; i++) {
+    matrix_scan_user();
+    quiet = stub_counters.reports == last ? quiet + 1 : 0;
+    last  = stub_counters.reports;
+  }
+}
+
+static void apply(const step_t *s, unsigned index) {
+  uint8_t packet[32] = {VIM_HINT_ID};
+  switch (s->kind) {
+    case TAP:
+      stub_tap(s->keycode);
+      break;
+    case DOWN:
+      held |= 1ull << (index + 1);
+      stub_event(s->keycode, true);
+      break;
+    case UP:
+      held &= ~(1ull << index);
+      stub_event(s->keycode, false);
+      break;
+    case HINT:
+      packet[1] = s->keycode;
+      raw_hid_receive(packet, sizeof(packet));
+      break;
+  }
+  drain();
+}
+
+/* a step that should end r{char}, taken while waiting for the char */
+static bool ends_replace(const step_t *s) {
+  if (vim.mode != REPLACE_MODE || vim_passthrough || gaming_mode || steno_active)
+    return false;
+  if (s->kind == TAP)
+    return s->keycode < QK_TO || s->keycode > QK_LAYER_TAP_TOGGLE_MAX;
+  return s->kind == DOWN && s->keycode < KC_LCTRL;
+}
+
+static const char *check(const step_t *s, bool esc_from_vim, bool replaced) {
+  static char msg[128];
+  if (mods_tx_depth != 0)
+    return "modifier transaction left open";
+  if (get_mods() != stub_sent_mods) {
+    snprintf(msg, sizeof(msg), "mods %02x but the last report had %02x", get_mods(), stub_sent_mods);
+    return msg;
+  }
+  if (get_mods() != stub_phys_mods) {
+    snprintf(msg, sizeof(msg), "mods %02x but the modifier keys down are %02x", get_mods(), stub_phys_mods);
+    return msg;
+  }
+  for (unsigned code = KC_A; code < KC_LCTRL; code++) {
+    if (stub_key_down(code) && !(stub_phys_keys[code / 8] & (1 << (code % 8)))) {
+      snprintf(msg, sizeof(msg), "keycode 0x%02x stuck down", code);
+      return msg;
+    }
+  }
+  if (vim.cmdsize >= CMDBUFFSIZE || vim.savedcmdsize >= CMDBUFFSIZE || vim.savesize > SAVEBUFFSIZE) {
+    snprintf(msg, sizeof(msg), "buffer out of bounds: cmdsize %u savedcmdsize %u savesize %u", vim.cmdsize, vim.savedcmdsize, vim.savesize);
+    return msg;
+  }
+  if (tap_queue_len > TAP_QUEUE_SIZE || tap_queue_head >= TAP_QUEUE_SIZE) {
+    snprintf(msg, sizeof(msg), "tap queue out of bounds: head %u len %u", tap_queue_head, tap_queue_len);
+    return msg;
+  }
+  if (tap_queue_len != 0)
+    return "tap queue didn't drain";
+  if (esc_from_vim && (vim.mode != COMMAND_MODE || vim.cmdsize != 0)) {
+    snprintf(msg, sizeof(msg), "VIM_ESC left mode %u with %u command chars", vim.mode, vim.cmdsize);
+    return msg;
+  }
+  if (replaced && vim.mode != COMMAND_MODE) {
+    snprintf(msg, sizeof(msg), "r then %s left mode %u", s->name, vim.mode);
+    return msg;
+  }
+  return NULL;
+}
+
+static void record(int depth, const char *why) {
+  if (run.violations++ >= MAX_REPORTED)
+    return;
+  char *out  = run.report[run.violations - 1];
+  size_t len = 0;
+  for (int i = 0; i <= depth && len < sizeof(run.report[0]); i++)
+    len += snprintf(out + len, sizeof(run.report[0]) - len, "%s ", steps[run.path[i]].name);
+  if (len < sizeof(run.report[0]))
+    snprintf(out + len, sizeof(run.report[0]) - len, "-> %s", why);
+}
+
+static void explore(int depth) {
+  char *here = run.snapshots + depth * (run.data_size + run.bss_size);
+  save(here);
+  for (unsigned i = 0; i < STEP_COUNT; i++) {
+    if (depth == 0 && i % run.workers != (unsigned)run.worker)
+      continue;
+    restore(here);
+    const step_t *s = &steps[i];
+    if (!step_valid(s, i))
+      continue;
+
+    bool esc_from_vim = s->keycode == VIM_ESC && !vim_passthrough && !gaming_mode && !steno_active;
+    bool replaced     = ends_replace(s);
+    apply(s, i);
+    run.events++;
+    run.path[depth] = i;
+
+    const char *why = check(s, esc_from_vim, replaced);
+    if (why) {
+      record(depth, why);
+      continue;
+    }
+    if (visit(hash_state(), run.depth - depth - 1) && depth + 1 < run.depth)
+      explore(depth + 1);
+  }
+  restore(here);
+}
+
+static void worker(int id, int fd) {
+  run.worker    = id;
+  run.data_size = __stop_keymap_data - __start_keymap_data;
+  run.bss_size  = __stop_keymap_bss - __start_keymap_bss;
+  run.snapshots = malloc((run.depth + 1) * (run.data_size + run.bss_size));
+  if (!run.snapshots) {
+    perror("vim_explore");
+    exit(2);
+  }
+  seen_grow();
+
+  stub_reset();
+  keyboard_post_init_user();
+  stub_tap(TT(3));
+  drain();
+  visit(hash_state(), run.depth);
+  explore(0);
+
+  result_t res = {.states = run.seen_count, .events = run.events, .violations = run.violations};
+  memcpy(res.report, run.report, sizeof(res.report));
+  if (write(fd, &res, sizeof(res)) != sizeof(res))
+    exit(2);
+  exit(0);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+  run.depth   = 4;
+  run.workers = sysconf(_SC_NPROCESSORS_ONLN);
+  while ((opt = getopt(argc, argv, "d:j:v")) != -1) {
+    switch (opt) {
+      case 'd':
+        run.depth = atoi(optarg);
+        break;
+      case 'j':
+        run.workers = atoi(optarg);
+        break;
+      case 'v':
+        run.verbose = true;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-d depth] [-j jobs] [-v]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (run.depth < 1 || run.depth > MAX_DEPTH || run.workers < 1) {
+    fprintf(stderr, "depth must be 1-%d and jobs at least 1\n", MAX_DEPTH);
+    return 2;
+  }
+  if (run.workers > (int)STEP_COUNT)
+    run.workers = STEP_COUNT;
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  int fds[run.workers];
+  for (int i = 0; i < run.workers; i++) {
+    int p[2];
+    if (pipe(p) != 0) {
+      perror("vim_explore");
+      return 2;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("vim_explore");
+      return 2;
+    }
+    if (pid == 0) {
+      close(p[0]);
+      worker(i, p[1]);
+    }
+    close(p[1]);
+    fds[i] = p[0];
+  }
+
+  result_t total = {0};
+  int printed = 0;
+  for (int i = 0; i < run.workers; i++) {
+    result_t res;
+    if (read(fds[i], &res, sizeof(res)) != sizeof(res)) {
+      fprintf(stderr, "worker %d died\n", i);
+      return 2;
+    }
+    total.states += res.states;
+    total.events += res.events;
+    total.violations += res.violations;
+    for (uint64_t r = 0; r < res.violations && r < MAX_REPORTED; r++)
+      if (run.verbose || printed++ < MAX_REPORTED)
+        printf("violation: %s\n", res.report[r]);
+  }
+  while (wait(NULL) > 0 || errno == EINTR)
+    ;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("depth %d, %d steps, %d jobs: %llu states, %llu steps run in %.2fs, %.0f states/s, %.0f steps/s\n",
+         run.depth, (int)STEP_COUNT, run.workers, (unsigned long long)total.states,
+         (unsigned long long)total.events, secs, total.states / secs, total.events / secs);
+  printf("%llu invariant violations\n", (unsigned long long)total.violations);
+  return total.violations ? 1 : 0;
+}
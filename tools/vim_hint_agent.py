@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""Send vim layer hints to the board over raw HID (see "Vim hints over raw HID"
+in readme.md).
+
+A stand-in for a real focus-tracking agent: with a hint name it sends just
+that one, which is enough to wire up to a window manager or editor hook; with
+none it sends all five in an order where every reply can be checked, and
+checks the echoed mode/visual/passthrough bytes (2-4) against what each hint
+should have done. Exits 1 if a reply is missing or wrong.
+
+    python3 tools/vim_hint_agent.py                 # check against the board
+    python3 tools/vim_hint_agent.py terminal        # real vim just got focus
+    python3 tools/vim_hint_agent.py --sim tools/build/hint_sim
+
+Talking to the board needs the hidapi module (pip install hidapi) and read
+access to the hidraw device. --sim runs the keymap's handler on the host
+instead (make -C tools builds hint_sim) and needs nothing else.
+"""
+import argparse
+import subprocess
+import sys
+
+USAGE_PAGE = 0xFF60
+USAGE = 0x61
+PACKET = 32
+VIM_HINT_ID = ord("v")
+
+# byte 1 of the packet, enum vim_hint in keymap.c
+HINTS = {
+    "text": 1,       # text field focused, vim emulation on
+    "terminal": 2,   # real vim focused, pass keys through
+    "selection": 3,  # visual mode on
+    "noselection": 4,
+    "reset": 5,      # forget a half typed command
+}
+
+# what each hint pins down in the reply: (visual, passthrough), None = untouched
+EFFECT = {
+    "text": (None, 0),
+    "terminal": (0, 1),
+    "selection": (1, None),
+    "noselection": (0, None),
+    "reset": (None, None),
+}
+
+# every hint once, starting from an unknown state, ending back on a text field
+CHECK_ORDER = ["reset", "text", "selection", "noselection", "terminal", "text"]
+
+MODE_COUNT = 7  # enum mode in keymap.c
+
+
+class Board:
+    def __init__(self, vid=None, pid=None):
+        try:
+            import hid
+        except ImportError:
+            sys.exit("needs the hidapi module: pip install hidapi")
+        for d in hid.enumerate(vid or 0, pid or 0):
+            if d["usage_page"] == USAGE_PAGE and d["usage"] == USAGE:
+                self.dev = hid.device()
+                self.dev.open_path(d["path"])
+                self.name = "%s (%04x:%04x)" % (d["product_string"], d["vendor_id"], d["product_id"])
+                return
+        sys.exit("no raw hid interface with usage page %04x usage %02x found" % (USAGE_PAGE, USAGE))
+
+    def send(self, packet, timeout_ms=500):
+        # hidapi wants the report id first, QMK's raw hid doesn't use one
+        self.dev.write([0] + list(packet))
+        reply = self.dev.read(PACKET, timeout_ms)
+        return bytes(reply) if reply else None
+
+    def close(self):
+        self.dev.close()
+
+
+class Sim:
+    def __init__(self, binary):
+        self.name = binary
+        self.proc = subprocess.Popen([binary], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+    def send(self, packet):
+        self.proc.stdin.write(bytes(packet))
+        self.proc.stdin.flush()
+        reply = self.proc.stdout.read(PACKET)
+        return reply if reply and any(reply) else None
+
+    def close(self):
+        self.proc.stdin.close()
+        self.proc.wait()
+
+
+def packet(hint):
+    p = bytearray(PACKET)
+    p[0] = VIM_HINT_ID
+    p[1] = HINTS[hint]
+    return p
+
+
+def check(link):
+    visual = passthrough = None
+    failures = 0
+    for hint in CHECK_ORDER:
+        reply = link.send(packet(hint))
+        want_visual, want_pass = EFFECT[hint]
+        if want_visual is not None:
+            visual = want_visual
+        if want_pass is not None:
+            passthrough = want_pass
+
+        if reply is None or len(reply) < 5:
+            print("%-12s no reply" % hint)
+            failures += 1
+            continue
+        mode, got_visual, got_pass = reply[2], reply[3], reply[4]
+        problems = []
+        if reply[0] != VIM_HINT_ID or reply[1] != HINTS[hint]:
+            problems.append("header %02x %02x not echoed" % (reply[0], reply[1]))
+        if mode >= MODE_COUNT:
+            problems.append("mode %d out of range" % mode)
+        if visual is not None and got_visual != visual:
+            problems.append("visual %d, want %d" % (got_visual, visual))
+        if passthrough is not None and got_pass != passthrough:
+            problems.append("passthrough %d, want %d" % (got_pass, passthrough))
+        # whatever the hint left alone is now known for the next one
+        visual, passthrough = got_visual, got_pass
+        print("%-12s mode %d visual %d passthrough %d  %s" % (
+            hint, mode, got_visual, got_pass, "; ".join(problems) or "ok"))
+        failures += bool(problems)
+    return failures
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("hint", nargs="?", choices=sorted(HINTS), help="send just this hint")
+    ap.add_argument("--sim", metavar="HINT_SIM", help="talk to the host build of the handler instead of the board")
+    ap.add_argument("--vid", type=lambda s: int(s, 16), help="only this vendor id (hex)")
+    ap.add_argument("--pid", type=lambda s: int(s, 16), help="only this product id (hex)")
+    args = ap.parse_args()
+
+    link = Sim(args.sim) if args.sim else Board(args.vid, args.pid)
+    try:
+        if args.hint:
+            reply = link.send(packet(args.hint))
+            if reply is None:
+                sys.exit("%s: no reply" % link.name)
+            print("mode %d visual %d passthrough %d" % (reply[2], reply[3], reply[4]))
+            return
+        failures = check(link)
+    finally:
+        link.close()
+    if failures:
+        sys.exit("%s: %d hint(s) failed" % (link.name, failures))
+
+
+if __name__ == "__main__":
+    main()